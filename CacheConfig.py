@@ -40,10 +40,45 @@
 # Configure the M5 cache hierarchy config in one place
 #
 
+import math
+import re
+
 import m5
 from m5.objects import *
+from m5.util.convert import toMemorySize
 from common.Caches import *
 from common import ObjectList
+from common import PolicySpec
+
+class L3Cache(Cache):
+    """Shared last-level cache of --l3cache, one instance per bank."""
+    assoc = 16
+    tag_latency = 20
+    data_latency = 20
+    response_latency = 20
+    mshrs = 32
+    tgts_per_mshr = 12
+    write_buffers = 16
+
+# Policies compared by --l2_shadow when no --l2_shadow_policy is given
+_default_shadow_policies = [
+    "LRURP",
+    "BIPRP",
+    "BRRIPRP",
+    "LRUIPVRP",
+    "LRUIPVRP:mru_pct=10",
+    "LRUIPVRP:adaptive=True",
+]
+
+def _shadow_labels(specs):
+    """Stat names of shadowed policy specs, e.g. LRUIPVRP_mru_pct_10."""
+    labels = []
+    for spec in specs:
+        label = re.sub(r'\W+', '_', spec).strip('_') or 'policy'
+        if label in labels:
+            label = '%s_%d' % (label, len(labels))
+        labels.append(label)
+    return labels
 
 def _get_hwp(hwp_option):
     if hwp_option == None:
@@ -67,16 +102,118 @@ def _get_cache_opts(level, options):
     if hasattr(options, prefetcher_attr):
         opts['prefetcher'] = _get_hwp(getattr(options, prefetcher_attr))
 
+    repl_spec = _get_repl_spec(level, options)
+    if repl_spec:
+        opts['replacement_policy'] = _make_repl_policy(repl_spec)
+
     return opts
 
+def _get_repl_spec(level, options):
+    """Replacement policy spec of a cache level, None for the default.
+
+    --<level>_repl takes precedence over --repl_policy, which applies to
+    every level but the walker caches.
+    """
+    spec = getattr(options, '{}_repl'.format(level), None)
+    if spec is None and level != 'walk':
+        spec = getattr(options, 'repl_policy', None)
+    return spec
+
+def _get_shadow_specs(options):
+    return getattr(options, "l2_shadow_policy", None) or \
+        (_default_shadow_policies
+         if getattr(options, "l2_shadow", False) else [])
+
+def _make_repl_policy(spec):
+    try:
+        return PolicySpec.make(spec)
+    except PolicySpec.PolicySpecError as e:
+        fatal("%s", e)
+
+def _check_repl_specs(options):
+    """Check every policy spec of the options before building caches."""
+    specs = [_get_repl_spec(level, options)
+             for level in ('l1i', 'l1d', 'l2', 'l3', 'walk')]
+    for spec in specs + _get_shadow_specs(options):
+        if spec:
+            try:
+                PolicySpec.check(spec)
+            except PolicySpec.PolicySpecError as e:
+                fatal("%s", e)
+
+def _print_repl_specs(options, levels):
+    print("Replacement policies: " +
+          ", ".join("{}={}".format(level,
+                                   _get_repl_spec(level, options) or
+                                   "default")
+                    for level in levels))
+
+def _add_shadow(cache, options):
+    """Shadow tags ranking other policies on the access stream of cache."""
+    specs = _get_shadow_specs(options)
+    if not specs:
+        return
+    policies = [_make_repl_policy(spec) for spec in specs]
+    # The policies only see the sampled sets, picked as ShadowTags does:
+    # size the state of those sized by the cache (LRUIPVRP) to match
+    line = options.cacheline_size
+    sets = toMemorySize(options.l2_size) // (line * options.l2_assoc)
+    stride = max(1, sets // max(1, options.l2_shadow_sets))
+    for policy in policies:
+        if 'cache_size' in type(policy)._params:
+            policy.cache_size = '%dB' % \
+                ((sets // stride) * options.l2_assoc * line)
+        # A line per access of every shadow would drown the real cache's
+        if 'verbose' in type(policy)._params:
+            policy.verbose = False
+    cache.shadow = ShadowTags(
+        manager=cache, sample_sets=options.l2_shadow_sets,
+        policies=policies, labels=_shadow_labels(specs))
+
+def _config_l3(options, system):
+    """Shared L3 banks behind system.tol3bus, in front of the membus.
+
+    With several banks, each one caches the cache lines of the memory
+    ranges whose low line address bits match its index, and accesses
+    outside of memory bypass the L3.
+    """
+    banks = options.num_l3caches
+    if banks < 1 or banks & (banks - 1):
+        fatal("--num-l3caches must be a power of 2")
+    intlv_bits = int(math.log(banks, 2))
+    intlv_low_bit = int(math.log(options.cacheline_size, 2))
+
+    system.tol3bus = L2XBar(clk_domain=system.cpu_clk_domain)
+    l3 = []
+    for i in range(banks):
+        opts = _get_cache_opts('l3', options)
+        opts['size'] = '%dB' % (toMemorySize(options.l3_size) // banks)
+        if banks > 1:
+            opts['addr_ranges'] = [
+                AddrRange(r.start, size=r.size(),
+                          intlvHighBit=intlv_low_bit + intlv_bits - 1,
+                          xorHighBit=0, intlvBits=intlv_bits,
+                          intlvMatch=i)
+                for r in system.mem_ranges]
+        bank = L3Cache(clk_domain=system.cpu_clk_domain, **opts)
+        bank.cpu_side = system.tol3bus.master
+        bank.mem_side = system.membus.slave
+        l3.append(bank)
+    system.l3 = l3
+    if banks > 1:
+        system.tol3bus.default = system.membus.slave
+
 def config_cache(options, system):
-    if options.external_memory_system and (options.caches or options.l2cache):
+    if options.external_memory_system and \
+       (options.caches or options.l2cache or options.l3cache):
         print("External caches and internal caches are exclusive options.\n")
         sys.exit(1)
 
     if options.external_memory_system:
         ExternalCache = ExternalCacheFactory(options.external_memory_system)
 
+    _check_repl_specs(options)
+
     if options.cpu_type == "O3_ARM_v7a_3":
         try:
             import cores.arm.O3_ARM_v7a as core
@@ -111,23 +248,21 @@ def config_cache(options, system):
     # minimal so that compute delays do not include memory access latencies.
     # Configure the compulsory L1 caches for the O3CPU, do not configure
     # any more caches.
-    if options.l2cache and options.elastic_trace_en:
+    if (options.l2cache or options.l3cache) and options.elastic_trace_en:
         fatal("When elastic trace is enabled, do not configure L2 caches.")
 
-    if options.l2cache:
+    if options.l3cache:
+        # Private L2s are built with the L1s of their CPU
+        _config_l3(options, system)
+    elif options.l2cache:
         # Provide a clock for the L2 and the L1-to-L2 bus here as they
         # are not connected using addTwoLevelCacheHierarchy. Use the
         # same clock as the CPUs.
         system.l2 = l2_cache_class(clk_domain=system.cpu_clk_domain,
                                    **_get_cache_opts('l2', options))
-                # ------------------------------------------------------------------
-        # Apply replacement policy for L2 cache (added for Project 4)
-        # ------------------------------------------------------------------
-        if hasattr(options, "repl_policy"):
-            system.l2.replacement_policy = eval(options.repl_policy)
-        else:
-            print("Warning: --repl_policy not provided, defaulting to LRU")
 
+        # Shadow tags: rank other policies on the L2 access stream
+        _add_shadow(system.l2, options)
 
         system.tol2bus = L2XBar(clk_domain = system.cpu_clk_domain)
         system.l2.cpu_side = system.tol2bus.master
@@ -136,26 +271,27 @@ def config_cache(options, system):
     if options.memchecker:
         system.memchecker = MemChecker()
 
+    if options.caches or options.l2cache or options.l3cache:
+        _print_repl_specs(options,
+                          (['l1i', 'l1d'] if options.caches else []) +
+                          (['walk'] if options.caches and walk_cache_class
+                           else []) +
+                          (['l2'] if options.l2cache or options.l3cache
+                           else []) +
+                          (['l3'] if options.l3cache else []))
+
     for i in range(options.num_cpus):
         if options.caches:
             icache = icache_class(**_get_cache_opts('l1i', options))
             dcache = dcache_class(**_get_cache_opts('l1d', options))
-                        # ------------------------------------------------------------------
-            # Apply replacement policy (added for Project 4)
-            # ------------------------------------------------------------------
-            if hasattr(options, "repl_policy"):
-                icache.replacement_policy = eval(options.repl_policy)
-                dcache.replacement_policy = eval(options.repl_policy)
-            else:
-                print("Warning: --repl_policy not provided, defaulting to LRU")
-
-         
 
             # If we have a walker cache specified, instantiate two
             # instances here
             if walk_cache_class:
-                iwalkcache = walk_cache_class()
-                dwalkcache = walk_cache_class()
+                iwalkcache = walk_cache_class(
+                    **_get_cache_opts('walk', options))
+                dwalkcache = walk_cache_class(
+                    **_get_cache_opts('walk', options))
             else:
                 iwalkcache = None
                 dwalkcache = None
@@ -204,7 +340,18 @@ def config_cache(options, system):
                         ExternalCache("cpu%d.dcache" % i))
 
         system.cpu[i].createInterruptController()
-        if options.l2cache:
+        if options.l3cache:
+            # Private L2, clocked like its CPU, below its own L1-to-L2 bus
+            system.cpu[i].l2 = l2_cache_class(
+                clk_domain=system.cpu_clk_domain,
+                **_get_cache_opts('l2', options))
+            _add_shadow(system.cpu[i].l2, options)
+            system.cpu[i].tol2bus = L2XBar(clk_domain=system.cpu_clk_domain)
+            system.cpu[i].l2.cpu_side = system.cpu[i].tol2bus.master
+            system.cpu[i].l2.mem_side = system.tol3bus.slave
+            system.cpu[i].connectAllPorts(system.cpu[i].tol2bus,
+                                          system.membus)
+        elif options.l2cache:
             system.cpu[i].connectAllPorts(system.tol2bus, system.membus)
         elif options.external_memory_system:
             system.cpu[i].connectUncachedPorts(system.membus)
@@ -42,6 +42,7 @@ from m5.objects import *
 
 from common.Benchmarks import *
 from common import ObjectList
+from common import PolicySpec
 
 vio_9p_help = """\
 Enable the Virtio 9P device and set the path to share. The default 9p path is
@@ -69,6 +70,14 @@ def _listRPTypes(option, opt, value, parser):
     ObjectList.rp_list.print()
     sys.exit(0)
 
+def _listRPParams(option, opt, value, parser):
+    try:
+        PolicySpec.print_params(value)
+    except PolicySpec.PolicySpecError as e:
+        print(e)
+        sys.exit(1)
+    sys.exit(0)
+
 def _listIndirectBPTypes(option, opt, value, parser):
     ObjectList.indirect_bp_list.print()
     sys.exit(0)
@@ -124,9 +133,14 @@ def addNoISAOptions(parser):
                       help="use external port for SystemC TLM cosimulation")
     parser.add_option("--caches", action="store_true")
     parser.add_option("--l2cache", action="store_true")
+    parser.add_option("--l3cache", action="store_true",
+                      help="Private L2 per CPU and a shared L3, banked "
+                      "by --num-l3caches (implies --l2cache)")
     parser.add_option("--num-dirs", type="int", default=1)
     parser.add_option("--num-l2caches", type="int", default=1)
-    parser.add_option("--num-l3caches", type="int", default=1)
+    parser.add_option("--num-l3caches", type="int", default=1,
+                      help="Number of L3 banks, interleaved on cache "
+                      "lines; --l3_size is their total size")
     parser.add_option("--l1d_size", type="string", default="64kB")
     parser.add_option("--l1i_size", type="string", default="32kB")
     parser.add_option("--l2_size", type="string", default="2MB")
@@ -136,8 +150,35 @@ def addNoISAOptions(parser):
     parser.add_option("--l2_assoc", type="int", default=8)
     parser.add_option("--l3_assoc", type="int", default=16)
     parser.add_option("--cacheline_size", type="int", default=64)
-    parser.add_option("--repl_policy", type="string", default="LRURP()",
-                  help="Replacement policy for caches (default: LRU)")
+    parser.add_option("--repl_policy", type="string", default="LRURP",
+                  help="Replacement policy for caches, as a spec such as "
+                  "LRUIPVRP:mru_pct=10,quantum=128 (default: LRURP)")
+    parser.add_option("--l1i_repl", type="string", default=None,
+                      help="Replacement policy of the L1 icaches "
+                      "(default: --repl_policy)")
+    parser.add_option("--l1d_repl", type="string", default=None,
+                      help="Replacement policy of the L1 dcaches "
+                      "(default: --repl_policy)")
+    parser.add_option("--l2_repl", type="string", default=None,
+                      help="Replacement policy of the L2 (default: "
+                      "--repl_policy)")
+    parser.add_option("--l3_repl", type="string", default=None,
+                      help="Replacement policy of the L3 (default: "
+                      "--repl_policy)")
+    parser.add_option("--walk_repl", type="string", default=None,
+                      help="Replacement policy of the page table walker "
+                      "caches (default: that of the walker cache class)")
+    parser.add_option("--l2_shadow", action="store_true",
+                      help="Evaluate alternative replacement policies on "
+                      "sampled L2 sets with shadow tags (LRU, BIP, BRRIP "
+                      "and LRUIPV variants unless --l2_shadow_policy is "
+                      "given)")
+    parser.add_option("--l2_shadow_policy", type="string", action="append",
+                      default=[], help="Replacement policy of one L2 "
+                      "shadow tag directory (repeat for each policy, "
+                      "implies --l2_shadow)")
+    parser.add_option("--l2_shadow_sets", type="int", default=64,
+                      help="Number of L2 sets sampled by the shadow tags")
 
 
     # Enable Ruby
@@ -194,6 +235,10 @@ def addCommonOptions(parser):
     parser.add_option("--list-rp-types",
                       action="callback", callback=_listRPTypes,
                       help="List available replacement policy types")
+    parser.add_option("--list-rp-params", type="string", metavar="RP",
+                      action="callback", callback=_listRPParams,
+                      help="List the parameters of a replacement policy "
+                      "type")
 
     parser.add_option("--list-hwp-types",
                       action="callback", callback=_listHWPTypes,
@@ -311,6 +356,23 @@ def addCommonOptions(parser):
         help="restore from a simpoint checkpoint taken with " +
              "--take-simpoint-checkpoints")
 
+    # SMARTS sampling options (see Sampling.py)
+    parser.add_option("--smarts", action="store", type="string",
+        help="<period,warmup,measure> switch to the detailed CPU every " +
+             "period instructions, warm up for warmup and measure " +
+             "measure instructions; the atomic --cpu-type warms the " +
+             "caches in between")
+    parser.add_option("--smarts-cpu", action="store", type="string",
+                      default="DerivO3CPU",
+                      help="CPU model of the SMARTS detailed windows")
+    parser.add_option("--smarts-windows", action="store", type="int",
+                      help="stop after this many SMARTS windows")
+    parser.add_option("--region-warmup", action="store", type="int",
+                      default=0,
+                      help="after --checkpoint-restore, simulate this many " +
+                           "instructions and reset the stats before " +
+                           "measuring --maxinsts instructions")
+
     # Checkpointing options
     ###Note that performing checkpointing via python script files will override
     ###checkpoint instructions built into binaries.
@@ -0,0 +1,107 @@
+# Replacement policy specs
+#
+# A spec names a replacement policy SimObject and the parameters to
+# override, e.g. "LRUIPVRP:mru_pct=10,quantum=128" or just "LRURP". The
+# Python-like form "LRUIPVRP(mru_pct=10, quantum=128)" is accepted too.
+# Specs are parsed without evaluating them, and checked against the
+# replacement policies registered in ObjectList.rp_list, so a bad name,
+# parameter or value is reported once, before anything is built, with
+# the parameters the policy does have.
+#
+# parse() and format_spec() do not need m5, so the driver scripts use
+# them to build specs as well.
+
+import re
+
+_SPEC_RE = re.compile(r'^\s*(\w+)\s*(?:\((.*)\)|:(.*))?\s*$', re.S)
+_PARAM_RE = re.compile(r'^[A-Za-z_]\w*$')
+
+class PolicySpecError(ValueError):
+    pass
+
+def _unquote(value):
+    if len(value) >= 2 and value[0] == value[-1] and value[0] in '\'"':
+        return value[1:-1]
+    return value
+
+def parse(spec):
+    """Split a spec into its policy name and (param, value) pairs.
+
+    Values are left as strings. Only the syntax is checked.
+    """
+    m = _SPEC_RE.match(spec)
+    if not m:
+        raise PolicySpecError("malformed replacement policy spec '%s'" %
+                              spec)
+    name = m.group(1)
+    args = m.group(2) if m.group(2) is not None else (m.group(3) or '')
+    params = []
+    for item in args.split(','):
+        item = item.strip()
+        if not item:
+            continue
+        key, sep, value = item.partition('=')
+        key, value = key.strip(), _unquote(value.strip())
+        if not sep or not _PARAM_RE.match(key) or not value:
+            raise PolicySpecError("'%s' in '%s' is not a param=value "
+                                  "pair" % (item, spec))
+        if key in (k for k, _ in params):
+            raise PolicySpecError("%s given twice in '%s'" % (key, spec))
+        params.append((key, value))
+    return name, params
+
+def format_spec(name, params=()):
+    """Spec of a policy name and (param, value) pairs, in the : form."""
+    if not params:
+        return name
+    return '%s:%s' % (name, ','.join('%s=%s' % (k, v) for k, v in params))
+
+def _policy_class(name):
+    from common import ObjectList
+
+    if name not in ObjectList.rp_list.get_names():
+        raise PolicySpecError("unknown replacement policy %s, see "
+                              "--list-rp-types" % name)
+    return ObjectList.rp_list.get(name)
+
+# Checked specs, so that every cache built from one spec shares the work
+_checked = {}
+
+def check(spec):
+    """Parse a spec and check it against the registered policies.
+
+    Returns the policy class and a dict of its converted parameter
+    values; raises PolicySpecError otherwise.
+    """
+    if spec in _checked:
+        return _checked[spec]
+    name, params = parse(spec)
+    cls = _policy_class(name)
+    values = {}
+    for key, value in params:
+        if key not in cls._params:
+            known = ', '.join(sorted(set(cls._params.keys())))
+            raise PolicySpecError("%s has no parameter %s; it has %s" %
+                                  (name, key, known))
+        try:
+            values[key] = cls._params[key].convert(value)
+        except Exception as e:
+            raise PolicySpecError("bad value '%s' for %s.%s: %s" %
+                                  (value, name, key, e))
+    _checked[spec] = (cls, values)
+    return cls, values
+
+def make(spec):
+    """New replacement policy object of a spec."""
+    cls, values = check(spec)
+    return cls(**values)
+
+def print_params(name):
+    """Print the parameters of a policy, with defaults and descriptions."""
+    cls = _policy_class(name)
+    print("%s parameters:" % name)
+    for key in sorted(set(cls._params.keys())):
+        desc = cls._params[key]
+        default = desc.default if hasattr(desc, 'default') else None
+        print("    %s (%s, default %s)" % (key, desc.ptype_str, default))
+        print("        %s" % desc.desc)
@@ -100,11 +100,72 @@ class WeightedLRURP(BaseReplacementPolicy):
     type = "WeightedLRURP"
     cxx_class = "ReplacementPolicy::WeightedLRU"
     cxx_header = "mem/cache/replacement_policies/weighted_lru_rp.hh"
+class IPVSchedule(Enum):
+    vals = ['front', 'spread', 'stochastic']
+
+class IPVBackend(Enum):
+    vals = ['automatic', 'age_vector', 'linked_list', 'bit_matrix',
+            'packed_nibble', 'perm_table', 'timestamp']
+
 class LRUIPVRP(BaseReplacementPolicy):
     type = "LRUIPVRP"
     cxx_class = "LRUIPVRP"
     cxx_header = "mem/cache/replacement_policies/lru_ipv.hh"
     numWays = Param.Int(Parent.assoc, "Set associativity")
+    cache_size = Param.MemorySize(Parent.size, "Size of the cache")
+    block_size = Param.Int(Parent.cache_line_size, "Block size in bytes")
+    backend = Param.IPVBackend('automatic', "Recency order "
+        "representation: age_vector (O(ways) per update), linked_list "
+        "(O(1) promotion and LRU insertion), bit_matrix (word-wide bit "
+        "operations, up to 64 ways), packed_nibble (one word per set, up "
+        "to 16 ways), perm_table (one precomputed transition per update, up "
+        "to 8 ways), timestamp (O(1) promotion and LRU insertion, O(ways) "
+        "victim search) or automatic, which picks perm_table up to 8 "
+        "ways, timestamp up to list_min_ways ways and linked_list above")
+    list_min_ways = Param.Unsigned(64, "Associativity above which the "
+        "automatic backend uses linked_list")
+    list_anchors = Param.Unsigned(4, "Skip anchors per set of linked_list, "
+        "used to insert at arbitrary positions (pf_insert_pos)")
+    deferred_hits = Param.Unsigned(0, "Hit promotions buffered per set "
+        "and applied in one pass when the exact order is needed; pays off "
+        "with age_vector and runs of hits to the same sets (0: promote "
+        "immediately)")
+    huge_pages = Param.Bool(False, "Back the per-block data slab with "
+        "transparent huge pages (Linux hosts)")
     mru_pct = Param.Percent(25, "Percent of inserts done at MRU (0..100)")
     quantum = Param.Int(64, "Period (inserts) over which the MRU percentage is enforced")
+    schedule = Param.IPVSchedule('front', "How MRU inserts are placed "
+        "within a quantum: all at its start (front), evenly spread "
+        "(spread) or drawn at random with probability mru_pct "
+        "(stochastic)")
+    seed = Param.UInt64(1, "Seed of the stochastic schedule generator")
+    adaptive = Param.Bool(False,
+        "Adjust mru_pct at runtime by hill climbing on the epoch miss rate")
+    epoch_length = Param.Unsigned(4096, "Insertions per adaptation epoch")
+    min_mru_pct = Param.Percent(0, "Lower bound for the adaptive mru_pct")
+    max_mru_pct = Param.Percent(100, "Upper bound for the adaptive mru_pct")
+    mru_pct_step = Param.Percent(5, "Adaptive mru_pct change per epoch")
+    trace_length = Param.Unsigned(64,
+        "Number of samples kept of the mru_pct time series")
+    per_requestor = Param.Bool(False, "Keep a separate insertion schedule "
+        "and adaptive controller per requestor (e.g. per core on a shared "
+        "L2)")
+    system = Param.System(Parent.any, "System the policy belongs to")
+    verbose = Param.Bool(True, "Print the set order on every touch, reset "
+        "and victim selection")
+    verbose_atomic = Param.Bool(True, "Also print while the memory system "
+        "is in atomic mode; disable to make fast-forward and functional "
+        "warming skip the prints")
+    ship = Param.Bool(False, "Choose the insertion position with a "
+        "signature history counter table indexed by the missing PC "
+        "(SHiP); fills without a PC keep using the IPV schedule")
+    shct_entries = Param.Unsigned(16384,
+        "Number of entries of the signature history counter table")
+    shct_bits = Param.Unsigned(3, "Bits per signature history counter")
+    pf_mru_pct = Param.Int(-1, "Percent of prefetch fills inserted at MRU, "
+        "using a schedule separate from demand fills (-1: prefetch fills "
+        "share the demand schedule)")
+    pf_insert_pos = Param.Int(-1, "Fixed recency position of prefetch "
+        "fills, 0 = LRU .. numWays-1 = MRU; overrides pf_mru_pct "
+        "(-1: disabled)")
 
@@ -0,0 +1,133 @@
+# SMARTS-style periodic sampling
+#
+# The workload runs on the atomic CPUs of the system, which keep the caches
+# and their replacement state functionally warm. Every --smarts period the
+# CPUs are switched to the detailed model for a short window: the first
+# instructions of the window warm up the pipeline and the last ones are
+# measured, with the stats reset before and dumped after the measurement.
+# Each dump of stats.txt is thus one sample; ipv_smarts.py turns them into
+# means and confidence intervals.
+#
+# Config scripts use it in place of Simulation.run():
+#
+#     if options.smarts:
+#         Sampling.run_smarts(options, root, system)
+#     elif options.region_warmup:
+#         Sampling.run_region(options, root, system, FutureClass)
+#     else:
+#         Simulation.run(options, root, system, FutureClass)
+#
+# run_region() is for the region runs of ipv_fork.py: it restores the
+# checkpoint, simulates --region-warmup instructions on the --cpu-type
+# model to refill the caches, which checkpoints leave empty, and resets
+# the stats before the measured --maxinsts instructions.
+
+import json
+import os
+
+import m5
+from m5.objects import *
+from m5.util import fatal
+
+from common import ObjectList
+from common import Simulation
+
+def parse_smarts(text):
+    """Split "period,warmup,measure" into three instruction counts."""
+    try:
+        period, warmup, measure = [int(x) for x in text.split(',')]
+    except ValueError:
+        fatal("--smarts expects <period,warmup,measure>, got %s" % text)
+    if measure <= 0 or warmup < 0 or warmup + measure >= period:
+        fatal("--smarts: warmup + measure must be below the period")
+    return period, warmup, measure
+
+def _run_insts(cpu, insts, cause):
+    """Simulate insts more instructions of cpu; True if they all ran."""
+    if insts == 0:
+        return True
+    cpu.scheduleInstStop(0, insts, cause)
+    exit_event = m5.simulate()
+    return exit_event.getCause() == cause
+
+def run_smarts(options, root, testsys):
+    period, warmup, measure = parse_smarts(options.smarts)
+    if options.num_cpus != 1:
+        fatal("--smarts supports a single CPU")
+    if not isinstance(testsys.cpu[0], AtomicSimpleCPU):
+        fatal("--smarts warms functionally: use an atomic --cpu-type")
+
+    DetailedClass = ObjectList.cpu_list.get(options.smarts_cpu)
+    detailed = DetailedClass(switched_out=True, cpu_id=0)
+    detailed.system = testsys
+    detailed.workload = testsys.cpu[0].workload
+    detailed.clk_domain = testsys.cpu[0].clk_domain
+    detailed.progress_interval = testsys.cpu[0].progress_interval
+    detailed.isa = testsys.cpu[0].isa
+    detailed.createThreads()
+    testsys.switch_cpus = [detailed]
+
+    m5.instantiate()
+    fast = testsys.cpu[0]
+    cause = "smarts window"
+    windows = 0
+    summary = os.path.join(m5.options.outdir, 'smarts.json')
+
+    while options.smarts_windows is None or \
+          windows < options.smarts_windows:
+        # Functional warming up to the next detailed window
+        if not _run_insts(fast, period - warmup - measure, cause):
+            break
+        m5.switchCpus(testsys, [(fast, detailed)])
+        done = not _run_insts(detailed, warmup, cause)
+        if not done:
+            m5.stats.reset()
+            done = not _run_insts(detailed, measure, cause)
+            if not done:
+                m5.stats.dump()
+                windows += 1
+                # Record progress, the dumps are only usable with it
+                with open(summary, 'w') as f:
+                    json.dump({'period': period, 'warmup': warmup,
+                               'measure': measure, 'windows': windows}, f)
+        if done:
+            break
+        m5.switchCpus(testsys, [(detailed, fast)])
+
+    print("SMARTS: %d windows of %d instructions measured every %d" %
+          (windows, measure, period))
+
+def run_region(options, root, testsys, cpu_class):
+    if options.num_cpus != 1:
+        fatal("--region-warmup supports a single CPU")
+    if options.checkpoint_restore is None:
+        fatal("--region-warmup needs --checkpoint-restore")
+
+    cptdir = options.checkpoint_dir or os.getcwd()
+    cpu = testsys.cpu[0]
+    if cpu_class:
+        # Restored with --restore-with-cpu, measured with --cpu-type
+        detailed = cpu_class(switched_out=True, cpu_id=0)
+        detailed.system = testsys
+        detailed.workload = cpu.workload
+        detailed.clk_domain = cpu.clk_domain
+        detailed.progress_interval = cpu.progress_interval
+        detailed.isa = cpu.isa
+        detailed.createThreads()
+        testsys.switch_cpus = [detailed]
+
+    _, checkpoint_dir = Simulation.findCptDir(options, cptdir, testsys)
+    m5.instantiate(checkpoint_dir)
+    if cpu_class:
+        m5.switchCpus(testsys, [(cpu, detailed)])
+        cpu = detailed
+
+    if not _run_insts(cpu, options.region_warmup, "region warmup"):
+        fatal("The workload ended during the %d instructions of "
+              "--region-warmup" % options.region_warmup)
+    m5.stats.reset()
+    if options.maxinsts:
+        cpu.scheduleInstStop(0, options.maxinsts, "region end")
+    exit_event = m5.simulate()
+    print("Exiting @ tick %i because %s" %
+          (m5.curTick(), exit_event.getCause()))
@@ -0,0 +1,19 @@
+from m5.params import *
+from m5.proxy import *
+from m5.objects.Probe import ProbeListenerObject
+
+class ShadowTags(ProbeListenerObject):
+    type = 'ShadowTags'
+    cxx_header = "mem/cache/replacement_policies/shadow_tags.hh"
+    size = Param.MemorySize(Parent.size, "Size of the observed cache")
+    assoc = Param.Int(Parent.assoc, "Associativity of the observed cache")
+    block_size = Param.Int(Parent.cache_line_size, "Block size in bytes")
+    sample_sets = Param.Unsigned(64, "Number of sets shadowed, spread "
+        "evenly over the cache")
+    policies = VectorParam.BaseReplacementPolicy("Replacement policies "
+        "to evaluate, one tag directory each; policies sized by the cache "
+        "(cache_size) should be given the sampled sets only")
+    labels = VectorParam.String([], "Stat names of the policies (default: "
+        "the policy object names)")
+    system = Param.System(Parent.any, "System of the observed cache, to "
+        "warn when its accesses cannot be observed (atomic mode)")
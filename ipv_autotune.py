@@ -0,0 +1,185 @@
+#!/usr/bin/env python3
+"""
+Successive-halving autotuner for the LRUIPVRP parameters (mru_pct,
+quantum and, optionally, the insertion schedule).
+
+Rather than replaying the whole trace for every point of the
+(mru_pct, quantum) grid, every candidate is first evaluated on a short
+prefix of the trace. Only the best 1/eta of the candidates survive to
+the next rung, which replays an eta times longer prefix. The prefixes
+are sized back from the last rung, which replays the full trace (or
+--max-accesses) for the one remaining candidate, so rung k of a search
+ending at rung L replays total / eta^(L - k) accesses.
+
+Evaluation uses the replay model in ipv_replay.py, so the output is a
+recommendation to be confirmed with a single gem5 run, e.g.:
+
+    ./ipv_autotune.py l2.trace --size 2MB --assoc 8
+    build/X86/gem5.opt configs/example/se.py ... \\
+        --repl_policy=LRUIPVRP:mru_pct=10,quantum=128
+"""
+
+import argparse
+import json
+import math
+import multiprocessing
+import sys
+
+import ipv_replay
+import PolicySpec
+
+# Trace and cache geometry of a worker process, set by _init_worker()
+_blocks = []
+_cache = {}
+
+
+def _parse_range(text):
+    """Parse "a,b,c" or "start:stop:step" (stop inclusive) into ints."""
+    if ':' in text:
+        parts = [int(x) for x in text.split(':')]
+        start, stop = parts[0], parts[1]
+        step = parts[2] if len(parts) > 2 else 1
+        return list(range(start, stop + 1, step))
+    return [int(x) for x in text.split(',') if x]
+
+
+def _init_worker(blocks, cache):
+    # Passed explicitly rather than inherited, so that workers also get
+    # them with the spawn start method (macOS, newer Pythons)
+    global _blocks
+    _blocks = blocks
+    _cache.update(cache)
+
+
+def _evaluate(job):
+    (mru_pct, quantum, schedule), limit = job
+    s = ipv_replay.replay(_blocks, _cache['size'], _cache['assoc'],
+                          _cache['block_size'], mru_pct, quantum, limit,
+                          schedule, _cache['seed'])
+    return ((mru_pct, quantum, schedule), s['miss_rate'], s['misses'],
+            s['accesses'])
+
+
+def successive_halving(configs, total, min_prefix, eta, pool):
+    """Run the halving schedule and return the per-rung results.
+
+    Each rung is a dict holding the prefix length and the list of
+    (config, miss_rate, misses, accesses) tuples it measured, sorted best
+    first. A config is a (mru_pct, quantum, schedule) tuple.
+    """
+    # Survivors of every rung, down to the single config of the last one
+    counts = [len(configs)]
+    while counts[-1] > 1:
+        counts.append(max(1, counts[-1] // eta))
+    last = len(counts) - 1
+    rungs = []
+    survivors = list(configs)
+    for k in range(last + 1):
+        # Sized from the last rung, which always replays the whole trace
+        prefix = min(total, max(min_prefix, total // eta ** (last - k)))
+        jobs = [(c, prefix) for c in survivors]
+        results = sorted(pool.map(_evaluate, jobs),
+                         key=lambda r: (r[1], r[0]))
+        rungs.append({'prefix': prefix, 'results': results})
+        if k < last:
+            survivors = [r[0] for r in results[:counts[k + 1]]]
+    return rungs
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Successive-halving search over LRUIPVRP parameters")
+    parser.add_argument("trace", help="Address trace (see ipv_replay.py)")
+    ipv_replay.add_cache_options(parser)
+    parser.add_argument("--mru-pct", default="0:100:5",
+                        help="mru_pct candidates, 'a,b,c' or "
+                        "'start:stop:step' (default: 0:100:5)")
+    parser.add_argument("--quantum", default="16,32,64,128,256,512",
+                        help="quantum candidates (default: "
+                        "16,32,64,128,256,512)")
+    parser.add_argument("--schedule", default="front",
+                        help="Comma separated schedules to try, among %s "
+                        "(default: front)" % ", ".join(ipv_replay.SCHEDULES))
+    parser.add_argument("--seed", type=int, default=1,
+                        help="Seed of the stochastic schedule (default: 1)")
+    parser.add_argument("--eta", type=int, default=3,
+                        help="Keep the best 1/ETA configs per rung and "
+                        "grow the prefix ETA times (default: 3)")
+    parser.add_argument("--min-prefix", type=int, default=10000,
+                        help="Shortest prefix, in accesses (default: 10000)")
+    parser.add_argument("--max-accesses", type=int, default=None,
+                        help="Only load the first MAX_ACCESSES accesses")
+    parser.add_argument("-j", "--jobs", type=int, default=None,
+                        help="Worker processes (default: all cores)")
+    parser.add_argument("--json", default=None,
+                        help="Also write the full results to this file")
+    args = parser.parse_args()
+
+    if args.eta < 2:
+        sys.exit("--eta must be at least 2")
+
+    blocks = ipv_replay.read_trace(args.trace, args.block_size,
+                                   args.max_accesses)
+    if not blocks:
+        sys.exit("No addresses found in %s" % args.trace)
+    cache = dict(size=args.size, assoc=args.assoc,
+                 block_size=args.block_size, seed=args.seed)
+
+    schedules = [x for x in args.schedule.split(',') if x]
+    for sched in schedules:
+        if sched not in ipv_replay.SCHEDULES:
+            sys.exit("Unknown schedule: %s" % sched)
+    configs = [(m, q, sched) for sched in schedules
+               for q in _parse_range(args.quantum)
+               for m in _parse_range(args.mru_pct)
+               if 0 <= m <= 100 and q > 0]
+    if not configs:
+        sys.exit("Empty search space")
+
+    pool = multiprocessing.Pool(args.jobs, initializer=_init_worker,
+                                initargs=(blocks, cache))
+    try:
+        rungs = successive_halving(configs, len(blocks), args.min_prefix,
+                                   args.eta, pool)
+    finally:
+        pool.close()
+        pool.join()
+
+    for i, rung in enumerate(rungs):
+        print("Rung %d: %d configs on %d accesses" %
+              (i, len(rung['results']), rung['prefix']))
+        for ((m, q, sched), rate, misses, accesses) in rung['results'][:5]:
+            print("    mru_pct=%3d quantum=%4d schedule=%-10s "
+                  "miss_rate=%.6f (%d/%d)" %
+                  (m, q, sched, rate, misses, accesses))
+
+    (m, q, sched), rate, _, accesses = rungs[-1]['results'][0]
+    print()
+    print("Recommended: mru_pct=%d quantum=%d schedule=%s (miss rate %.6f "
+          "on %d accesses)" % (m, q, sched, rate, accesses))
+    params = [('mru_pct', m), ('quantum', q)]
+    if sched != 'front':
+        params.append(('schedule', sched))
+    if sched == 'stochastic':
+        params.append(('seed', args.seed))
+    print("  --repl_policy=%s" % PolicySpec.format_spec('LRUIPVRP', params))
+
+    if args.json:
+        with open(args.json, 'w') as f:
+            json.dump({
+                'trace': args.trace,
+                'cache': cache,
+                'recommended': {'mru_pct': m, 'quantum': q,
+                                'schedule': sched, 'miss_rate': rate},
+                'rungs': [{'prefix': r['prefix'],
+                           'results': [dict(zip(('mru_pct', 'quantum',
+                                                 'schedule', 'miss_rate',
+                                                 'misses', 'accesses'),
+                                                x[0] + x[1:]))
+                                       for x in r['results']]}
+                          for r in rungs],
+            }, f, indent=2)
+
+
+if __name__ == '__main__':
+    main()
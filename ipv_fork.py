@@ -0,0 +1,167 @@
+#!/usr/bin/env python3
+"""
+Checkpoint-and-fork evaluation of several replacement policies on the
+same region of a workload.
+
+Instead of one full run per policy, each with its own fast-forward, the
+workload is fast-forwarded and warmed once, up to the region of
+interest, and a checkpoint is taken there. One gem5 process per policy
+then restores that checkpoint with its own --repl_policy and runs the
+region, all in parallel on the local cores and each in its own output
+directory:
+
+    ./ipv_fork.py --gem5 build/X86/gem5.opt --roi-tick 5000000000 \\
+        --policy LRURP --policy LRUIPVRP:mru_pct=10 \\
+        --policy LRUIPVRP:mru_pct=10,adaptive=True \\
+        --region="--maxinsts=100000000" --outdir fork.out -- \\
+        configs/example/se.py -c dijkstra -o input.dat \\
+        --caches --l2cache --cpu-type=DerivO3CPU
+
+Everything after "--" is the config script and its options, shared by
+all runs. The warm-up runs with --warmup-cpu and --warmup-policy (the
+first --policy by default); the children restore into --cpu-type of the
+script options.
+
+Only the policy metadata is warm at the start of the region: LRUIPVRP
+children restore the SHCT and schedule state left by an LRUIPVRP
+warm-up (see LRUIPVRP::unserialize()), other policies start from their
+initial state, and the caches themselves come back empty, as classic
+cache contents are not part of gem5 checkpoints. --region-warmup N has
+every child simulate N instructions on --cpu-type to refill its caches
+and reset the stats before measuring the region; the config script must
+then call Sampling.run_region() (see Sampling.py), which is checked
+before anything runs.
+
+Layout of --outdir: ckpt/ holds the checkpoint, warmup/ the warm-up run
+and one directory per policy the region runs. A summary table (CPI, and the
+replacement policy and MPKI of the caches given by --cache) is printed
+at the end.
+"""
+
+import argparse
+import json
+import os
+import shlex
+import sys
+
+import ipv_gem5
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Warm up once, then evaluate several replacement "
+        "policies from the same checkpoint in parallel",
+        usage="%(prog)s [options] -- script.py [script options]")
+    parser.add_argument("--gem5", required=True, help="gem5 binary")
+    parser.add_argument("--policy", action="append", default=[],
+                        required=True, help="Replacement policy spec, as "
+                        "given to --repl_policy (repeat for each policy)")
+    parser.add_argument("--roi-tick", type=int, required=True,
+                        help="Tick of the region of interest, where the "
+                        "checkpoint is taken")
+    parser.add_argument("--warmup-policy", default=None,
+                        help="Policy used while warming up (default: the "
+                        "first --policy)")
+    parser.add_argument("--warmup-cpu", default="AtomicSimpleCPU",
+                        help="CPU model of the warm-up (default: "
+                        "AtomicSimpleCPU)")
+    parser.add_argument("--region", default="",
+                        help="Extra script options of the region runs, "
+                        "e.g. --region=\"--maxinsts=100000000\"")
+    parser.add_argument("--region-warmup", type=int, default=0,
+                        metavar="N",
+                        help="Instructions simulated by every region run "
+                        "before its stats are reset (default: 0)")
+    parser.add_argument("--outdir", default="fork.out",
+                        help="Output directory (default: fork.out)")
+    parser.add_argument("--cache", action="append", default=None,
+                        help="Cache to report the MPKI of (default: "
+                        "system.l2)")
+    parser.add_argument("-j", "--jobs", type=int, default=None,
+                        help="Parallel region runs (default: all cores)")
+    parser.add_argument("--no-pin", action="store_true",
+                        help="Do not pin every region run to its own core")
+    parser.add_argument("--skip-warmup", action="store_true",
+                        help="Reuse the checkpoint of a previous run")
+    parser.add_argument("--json", default=None,
+                        help="Also write the summary to this file")
+    parser.add_argument("script", nargs=argparse.REMAINDER,
+                        help="Config script and its options, after --")
+    args = parser.parse_args()
+    ipv_gem5.check_specs(args.policy + [s for s in [args.warmup_policy] if s])
+
+    script = [a for a in args.script if a != '--'][:1]
+    script_args = [a for a in args.script if a != '--'][1:]
+    if not script:
+        sys.exit("No config script given after --")
+    if args.region_warmup and \
+            not ipv_gem5.calls_sampling(script[0], 'run_region'):
+        sys.exit("%s does not call Sampling.run_region(), which "
+                 "--region-warmup needs" % script[0])
+    caches = args.cache or ['system.l2']
+
+    outdir = os.path.abspath(args.outdir)
+    ckpt_dir = os.path.join(outdir, 'ckpt')
+    if not args.skip_warmup:
+        warm_policy = args.warmup_policy or args.policy[0]
+        cmd = ipv_gem5.gem5_command(
+            args.gem5, os.path.join(outdir, 'warmup'), script[0],
+            script_args,
+            ['--cpu-type=%s' % args.warmup_cpu,
+             '--repl_policy=%s' % warm_policy,
+             '--take-checkpoints=%d,%d' % (args.roi_tick, args.roi_tick),
+             '--max-checkpoints=1', '--checkpoint-dir=%s' % ckpt_dir])
+        print("Warming up with %s to tick %d" % (warm_policy, args.roi_tick))
+        if ipv_gem5.run(cmd, os.path.join(outdir, 'warmup')) != 0:
+            sys.exit("Warm-up failed, see %s" %
+                     os.path.join(outdir, 'warmup', 'run.log'))
+    if not os.path.isdir(ckpt_dir) or not os.listdir(ckpt_dir):
+        sys.exit("No checkpoint in %s" % ckpt_dir)
+
+    labels = ipv_gem5.unique_labels(args.policy)
+    region = shlex.split(args.region)
+    if args.region_warmup:
+        region.append('--region-warmup=%d' % args.region_warmup)
+    jobs = []
+    for spec, label in zip(args.policy, labels):
+        run_dir = os.path.join(outdir, label)
+        jobs.append((ipv_gem5.gem5_command(
+            args.gem5, run_dir, script[0], script_args,
+            ['--checkpoint-dir=%s' % ckpt_dir, '--checkpoint-restore=1',
+             '--restore-with-cpu=%s' % args.warmup_cpu,
+             '--repl_policy=%s' % spec] + region), run_dir))
+    print("Running %d policies from %s" % (len(jobs), ckpt_dir))
+    status = ipv_gem5.run_all(jobs, args.jobs, pin=not args.no_pin)
+
+    rows = []
+    for spec, label, (_, run_dir), code in zip(args.policy, labels, jobs,
+                                               status):
+        row = {'policy': spec, 'dir': run_dir, 'status': code}
+        stats_file = os.path.join(run_dir, 'stats.txt')
+        config_file = os.path.join(run_dir, 'config.ini')
+        if code == 0 and os.path.exists(stats_file):
+            policies = (ipv_gem5.read_policies(config_file)
+                        if os.path.exists(config_file) else None)
+            row.update(ipv_gem5.summarize(ipv_gem5.read_stats(stats_file),
+                                          caches, policies))
+        else:
+            print("%s failed (status %d), see %s" %
+                  (spec, code, os.path.join(run_dir, 'run.log')))
+        rows.append(row)
+
+    columns = ['policy', 'cpi'] + \
+              ['%s_%s' % (c.split('.')[-1], m) for c in caches
+               for m in ('policy', 'mpki')] + ['insts']
+    print()
+    ipv_gem5.print_table(rows, columns)
+
+    if args.json:
+        with open(args.json, 'w') as f:
+            json.dump({'roi_tick': args.roi_tick, 'runs': rows}, f,
+                      indent=2)
+    if any(status):
+        sys.exit(1)
+
+
+if __name__ == '__main__':
+    main()
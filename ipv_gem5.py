@@ -0,0 +1,340 @@
+#!/usr/bin/env python3
+"""
+Helpers shared by the scripts that drive gem5 for replacement policy
+studies: building gem5 command lines, running them on the local cores
+and reading the resulting stats.txt files.
+
+Nothing here imports m5; the scripts using it run gem5 as a subprocess,
+one output directory per run.
+"""
+
+import ast
+import math
+import multiprocessing
+import multiprocessing.pool
+import os
+import re
+import resource
+import subprocess
+import sys
+import threading
+
+import PolicySpec
+import ipv_store
+
+_LABEL_RE = re.compile(r'[^A-Za-z0-9_.=-]+')
+_STAT_RE = re.compile(r'^(\S+)\s+(\S+)')
+_BEGIN = '---------- Begin Simulation Statistics ----------'
+
+
+def policy_label(spec):
+    """File name friendly label of a policy spec.
+
+    "LRUIPVRP:mru_pct=10,quantum=128" gives
+    "LRUIPVRP_mru_pct=10_quantum=128".
+    """
+    return _LABEL_RE.sub('_', spec).strip('_') or 'policy'
+
+
+def unique_labels(specs):
+    """policy_label() of every spec, suffixed where two would collide."""
+    labels, seen = [], {}
+    for spec in specs:
+        label = policy_label(spec)
+        seen[label] = seen.get(label, 0) + 1
+        labels.append(label if seen[label] == 1
+                      else '%s.%d' % (label, seen[label]))
+    return labels
+
+
+def gem5_command(gem5, outdir, script, script_args=(), extra_args=()):
+    """Command line of one gem5 run writing to outdir.
+
+    extra_args come last, so they override options of script_args.
+    """
+    return ([gem5, '--outdir=%s' % outdir, script] + list(script_args) +
+            list(extra_args))
+
+
+def _imports(path, source, root):
+    """Files under root or next to path of the modules source imports."""
+    try:
+        tree = ast.parse(source, path)
+    except SyntaxError:
+        return []
+    names = []
+    for node in ast.walk(tree):
+        if isinstance(node, ast.Import):
+            names += [alias.name for alias in node.names]
+        elif isinstance(node, ast.ImportFrom) and node.module and \
+                not node.level:
+            # "from common import Simulation" may name a module
+            names.append(node.module)
+            names += ['%s.%s' % (node.module, alias.name)
+                      for alias in node.names]
+    files = []
+    for name in names:
+        for base in (root, os.path.dirname(os.path.abspath(path))):
+            candidate = os.path.join(base, *name.split('.')) + '.py'
+            if os.path.isfile(candidate):
+                files.append(os.path.abspath(candidate))
+    return files
+
+
+def calls_sampling(script, function):
+    """Whether a config script, or a config module it imports directly or
+    indirectly, calls Sampling.<function>(), e.g. run_smarts.
+
+    Sampling.py itself and the ipv_* tools, which only mention the call,
+    are not looked at, nor are calls in comments.
+    """
+    call = re.compile(r'^[^#\n]*\bSampling\.%s\(' % re.escape(function),
+                      re.M)
+    root = ipv_store.config_root(script)
+    todo, seen = [os.path.abspath(script)], set()
+    while todo:
+        path = todo.pop()
+        name = os.path.basename(path)
+        if path in seen or (path != os.path.abspath(script) and
+                            (name == 'Sampling.py' or
+                             name.startswith('ipv_'))):
+            continue
+        seen.add(path)
+        with open(path) as f:
+            source = f.read()
+        if call.search(source):
+            return True
+        todo += _imports(path, source, root)
+    return False
+
+
+# Exit status of a run killed for exceeding its time limit, as timeout(1)
+TIMEOUT = 124
+
+
+def run(cmd, outdir, cpu=None, timeout=None, mem_limit=None):
+    """Run a gem5 command, logging to outdir/run.log.
+
+    When cpu is given the process is pinned to that host core. timeout
+    (seconds) kills the run, which then returns TIMEOUT; mem_limit
+    (bytes) caps its address space. Returns the exit status.
+    """
+    if not os.path.isdir(outdir):
+        os.makedirs(outdir)
+
+    with open(os.path.join(outdir, 'run.log'), 'w') as log:
+        log.write(' '.join(cmd) + '\n')
+        log.flush()
+        proc = subprocess.Popen(cmd, stdout=log, stderr=subprocess.STDOUT)
+        # Applied to the child from here: a preexec_fn is not safe in the
+        # threads of run_all()
+        try:
+            if cpu is not None and hasattr(os, 'sched_setaffinity'):
+                os.sched_setaffinity(proc.pid, [cpu])
+            if mem_limit and hasattr(resource, 'prlimit'):
+                resource.prlimit(proc.pid, resource.RLIMIT_AS,
+                                 (mem_limit, mem_limit))
+        except ProcessLookupError:
+            pass
+        try:
+            return proc.wait(timeout=timeout)
+        except subprocess.TimeoutExpired:
+            proc.kill()
+            proc.wait()
+            log.write('\nKilled after %g s\n' % timeout)
+            return TIMEOUT
+
+
+def host_cpus():
+    """Host cores this process may run on."""
+    if hasattr(os, 'sched_getaffinity'):
+        return sorted(os.sched_getaffinity(0))
+    return list(range(multiprocessing.cpu_count()))
+
+
+def run_all(jobs, workers=None, pin=False, retries=0, timeout=None,
+            mem_limit=None, progress=None):
+    """Run (cmd, outdir) jobs, at most workers at a time.
+
+    With pin, each job is pinned to its own host core (jobs sharing a
+    core only when there are more workers than cores). A failing job is
+    run again up to retries times; timeout and mem_limit apply to every
+    attempt, see run(). progress(index, status, attempt) is called after
+    every attempt. Returns the exit status of every job, in order.
+    """
+    cpus = host_cpus()
+    workers = min(len(jobs), workers or len(cpus)) or 1
+    # Jobs running on every core; with more workers than cores, cores
+    # are shared round-robin
+    load = dict((cpu, 0) for cpu in cpus)
+    lock = threading.Lock()
+
+    def one(indexed):
+        index, (cmd, outdir) = indexed
+        cpu = None
+        if pin:
+            with lock:
+                cpu = min(cpus, key=lambda c: load[c])
+                load[cpu] += 1
+        try:
+            for attempt in range(1, retries + 2):
+                status = run(cmd, outdir, cpu, timeout, mem_limit)
+                if progress:
+                    with lock:
+                        progress(index, status, attempt)
+                if status == 0:
+                    break
+            return status
+        finally:
+            if pin:
+                with lock:
+                    load[cpu] -= 1
+
+    pool = multiprocessing.pool.ThreadPool(workers)
+    try:
+        return pool.map(one, list(enumerate(jobs)), chunksize=1)
+    finally:
+        pool.close()
+        pool.join()
+
+
+def with_param(spec, cls, name, value):
+    """spec with name=value added if it is a cls spec not setting name.
+
+    with_param("LRUIPVRP:mru_pct=10", "LRUIPVRP", "verbose", False)
+    gives "LRUIPVRP:mru_pct=10,verbose=False"; specs of other classes
+    are returned unchanged.
+    """
+    policy, params = PolicySpec.parse(spec)
+    if policy != cls or name in (k for k, _ in params):
+        return spec
+    return PolicySpec.format_spec(policy, params + [(name, value)])
+
+
+def check_specs(specs):
+    """Exit with the error of the first malformed policy spec, if any.
+
+    Only the syntax is checked here; gem5 checks the policy and parameter
+    names when it builds the caches.
+    """
+    for spec in specs:
+        try:
+            PolicySpec.parse(spec)
+        except PolicySpec.PolicySpecError as e:
+            sys.exit(str(e))
+
+
+def read_stats(path, dump=-1):
+    """Stats of one dump of a gem5 stats.txt, as a {name: float} dict.
+
+    dump indexes the dumps of the file (default: the last one). Returns
+    an empty dict if the file has no dumps.
+    """
+    dumps = read_all_stats(path)
+    return dumps[dump] if dumps else {}
+
+
+def read_all_stats(path):
+    """Every dump of a gem5 stats.txt, in order, as {name: float} dicts."""
+    dumps = []
+    with open(path) as f:
+        for line in f:
+            if line.startswith(_BEGIN):
+                dumps.append({})
+                continue
+            m = _STAT_RE.match(line)
+            if not m or not dumps:
+                continue
+            try:
+                dumps[-1][m.group(1)] = float(m.group(2))
+            except ValueError:
+                pass
+    return dumps
+
+
+def find_stat(stats, *patterns):
+    """Value of the first stat whose name matches one of the regexes."""
+    for pattern in patterns:
+        regex = re.compile(pattern + '$')
+        for name in sorted(stats):
+            if regex.match(name):
+                return stats[name]
+    return None
+
+
+# Main metrics, matching both the pre and post v21 stat names
+_INSTS = (r'simInsts', r'sim_insts')
+_CPI = (r'system\.switch_cpus\d*\.cpi(::total)?',
+        r'system\.cpu\d*\.cpi(::total)?')
+
+
+def cache_misses(stats, cache):
+    """Total misses of a cache, e.g. cache="system.l2".
+
+    The misses of banked caches (system.l30, system.l31, ...) are summed.
+    """
+    c = re.escape(cache)
+    misses = find_stat(stats, c + r'\.overallMisses::total',
+                       c + r'\.overall_misses::total')
+    if misses is not None:
+        return misses
+    banks = re.compile(c + r'\d+\.(overallMisses|overall_misses)::total$')
+    values = [v for name, v in stats.items() if banks.match(name)]
+    return sum(values) if values else None
+
+
+def read_policies(path):
+    """Replacement policy of every cache of a gem5 config.ini.
+
+    Returns a {cache: policy type} dict, e.g. {"system.l2": "LRUIPVRP"}.
+    """
+    policies, section = {}, None
+    suffix = '.replacement_policy'
+    with open(path) as f:
+        for line in f:
+            line = line.strip()
+            if line.startswith('[') and line.endswith(']'):
+                section = line[1:-1]
+            elif (section and section.endswith(suffix) and
+                  line.startswith('type=')):
+                policies[section[:-len(suffix)]] = line[len('type='):]
+    return policies
+
+
+def summarize(stats, caches=('system.l2',), policies=None):
+    """CPI, instructions and per-cache MPKI of a stats dict.
+
+    With the read_policies() of the run, the replacement policy of each
+    cache is given too, as "<cache>_policy".
+    """
+    insts = find_stat(stats, *_INSTS)
+    summary = {'insts': insts, 'cpi': find_stat(stats, *_CPI)}
+    for cache in caches:
+        misses = cache_misses(stats, cache)
+        name = cache.split('.')[-1]
+        summary['%s_mpki' % name] = (1000.0 * misses / insts
+                                     if misses is not None and insts
+                                     else None)
+        if policies is not None:
+            summary['%s_policy' % name] = policies.get(
+                cache, policies.get(cache + '0'))
+    return summary
+
+
+def format_value(value):
+    if value is None or (isinstance(value, float) and math.isnan(value)):
+        return '-'
+    if isinstance(value, float):
+        return '%d' % value if value.is_integer() else '%.4f' % value
+    return str(value)
+
+
+def print_table(rows, columns, out=None):
+    """Print a list of dicts as an aligned text table."""
+    cells = [[c for c in columns]] + \
+            [[format_value(r.get(c)) for c in columns] for r in rows]
+    widths = [max(len(row[i]) for row in cells) for i in range(len(columns))]
+    for row in cells:
+        line = '  '.join(cell.ljust(w) if i == 0 else cell.rjust(w)
+                         for i, (cell, w) in enumerate(zip(row, widths)))
+        print(line, file=out)
@@ -0,0 +1,242 @@
+/**
+ * Synthetic access-pattern kernels for replacement policy evaluation.
+ *
+ * Each kernel reads one word per cache line in a pattern chosen to
+ * separate replacement policies, over a footprint given on the command
+ * line so that it can be sized against the cache under study. The line
+ * sequences are the ones ipv_workloads.py generates for the replay
+ * model (same generator, same seeds), so a pattern can be explored with
+ * ipv_replay.py / ipv_autotune.py and then confirmed in gem5.
+ *
+ * Build statically for the simulated ISA (no gem5 headers are needed):
+ *
+ *   g++ -O2 -static -std=c++14 \
+ *       src/mem/cache/replacement_policies/ipv_kernels.cc -o ipv_kernels
+ *
+ * and run it like any SE-mode workload:
+ *
+ *   build/X86/gem5.opt configs/example/se.py -c ipv_kernels \
+ *       -o "cyclic 2560kB 20000000" --caches --l2cache
+ *
+ * Usage: ipv_kernels <pattern> <footprint> [accesses] [name=value ...]
+ *
+ * N is the number of lines of the footprint. Patterns:
+ *
+ * - cyclic: lines 0, 1, ..., N-1, 0, 1, ... With N above the cache
+ *   size, LRU misses on every access while IPV with a low mru_pct keeps
+ *   part of the loop resident.
+ * - scan_hot: hot_per_scan (3) random accesses to N hot lines, then one
+ *   line of a streaming scan over scan (8N) other lines. IPV protects the
+ *   hot set from the scan, LRU does not once the scan outpaces it.
+ * - zipf: random lines with Zipf(alpha = 0.99) popularity. Mostly
+ *   recency friendly: LRU is good and IPV should be about as good.
+ * - chase: dependent loads along a random cycle over the N lines. The
+ *   reuse is that of cyclic, with no spatial locality or memory level
+ *   parallelism, so misses are exposed in the CPI.
+ * - phases: phase (accesses / 8) accesses of cyclic over N lines, then
+ *   of cyclic over N/4 other lines, and so on. With N somewhat above
+ *   the cache size, the first phase wants LRU insertion and the second
+ *   MRU insertion; a static mru_pct of 0 never loads the second working
+ *   set, so it shows the need for adaptive (or BIP-like) insertion.
+ *
+ * Other parameters: line (64), seed (1). The kernel prints its
+ * parameters and a checksum of the loaded words.
+ */
+
+#include <algorithm>
+#include <cinttypes>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace
+{
+
+struct Params
+{
+    std::string pattern;
+    uint64_t footprint = 0;
+    uint64_t accesses = 10000000;
+    uint64_t line = 64;
+    uint64_t seed = 1;
+    uint64_t scan = 0;          ///< Scan lines of scan_hot (0: 8N)
+    uint64_t hotPerScan = 3;
+    double alpha = 0.99;
+    uint64_t phase = 0;         ///< Accesses per phase (0: accesses / 8)
+};
+
+/** Same generator as LRUIPVRP::nextRandom() and ipv_replay.XorShift64 */
+class XorShift64
+{
+  public:
+    explicit XorShift64(uint64_t seed)
+        : state(seed ? seed : 0x9E3779B97F4A7C15ULL)
+    {
+    }
+
+    uint64_t
+    next()
+    {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    }
+
+    /** Uniform double in [0, 1) */
+    double
+    uniform()
+    {
+        return (next() >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+  private:
+    uint64_t state;
+};
+
+uint64_t
+parseSize(const char *text)
+{
+    char *end;
+    uint64_t value = std::strtoull(text, &end, 10);
+    switch (*end) {
+      case 'k': case 'K': return value << 10;
+      case 'm': case 'M': return value << 20;
+      case 'g': case 'G': return value << 30;
+      default: return value;
+    }
+}
+
+/** Zipf rank in [0, n) of u, by the continuous inverse CDF */
+uint64_t
+zipfRank(double u, uint64_t n, double alpha)
+{
+    double x;
+    if (std::fabs(alpha - 1.0) < 1e-9) {
+        x = std::pow(n + 1.0, u);
+    } else {
+        double a = 1.0 - alpha;
+        x = std::pow((std::pow(n + 1.0, a) - 1.0) * u + 1.0, 1.0 / a);
+    }
+    uint64_t rank = (uint64_t)x - 1;
+    return rank < n ? rank : n - 1;
+}
+
+/** Successor array of a random cycle over n elements (Sattolo) */
+void
+randomCycle(uint64_t *next, uint64_t n, uint64_t stride, XorShift64 &rng)
+{
+    for (uint64_t i = 0; i < n; ++i)
+        next[i * stride] = i;
+    for (uint64_t i = n - 1; i > 0; --i) {
+        uint64_t j = rng.next() % i;
+        std::swap(next[i * stride], next[j * stride]);
+    }
+}
+
+bool
+parseParam(Params &p, const char *arg)
+{
+    const char *eq = std::strchr(arg, '=');
+    if (!eq) return false;
+    std::string name(arg, eq - arg);
+    const char *value = eq + 1;
+    if (name == "line") p.line = parseSize(value);
+    else if (name == "seed") p.seed = std::strtoull(value, nullptr, 10);
+    else if (name == "scan") p.scan = std::strtoull(value, nullptr, 10);
+    else if (name == "hot_per_scan")
+        p.hotPerScan = std::strtoull(value, nullptr, 10);
+    else if (name == "alpha") p.alpha = std::strtod(value, nullptr);
+    else if (name == "phase") p.phase = std::strtoull(value, nullptr, 10);
+    else return false;
+    return true;
+}
+
+} // anonymous namespace
+
+int
+main(int argc, char **argv)
+{
+    Params p;
+    if (argc < 3) {
+        std::fprintf(stderr, "Usage: %s <cyclic|scan_hot|zipf|chase|"
+                     "phases> <footprint> [accesses] [name=value ...]\n",
+                     argv[0]);
+        return 1;
+    }
+    p.pattern = argv[1];
+    p.footprint = parseSize(argv[2]);
+    int argi = 3;
+    if (argi < argc && !std::strchr(argv[argi], '='))
+        p.accesses = std::strtoull(argv[argi++], nullptr, 10);
+    for (; argi < argc; ++argi) {
+        if (!parseParam(p, argv[argi])) {
+            std::fprintf(stderr, "Unknown parameter %s\n", argv[argi]);
+            return 1;
+        }
+    }
+
+    const uint64_t n = p.footprint / p.line;
+    const uint64_t stride = p.line / sizeof(uint64_t);
+    if (n < 4 || stride == 0) {
+        std::fprintf(stderr, "Footprint too small\n");
+        return 1;
+    }
+    const uint64_t scan = p.scan ? p.scan : 8 * n;
+    const uint64_t phase = p.phase ? p.phase : std::max<uint64_t>(
+        1, p.accesses / 8);
+
+    // One region holds every line the pattern touches
+    uint64_t lines = n;
+    if (p.pattern == "scan_hot") lines = n + scan;
+    else if (p.pattern == "phases") lines = n + n / 4;
+    // Every line holds its index, so the checksum depends on the order
+    std::vector<uint64_t> buf(lines * stride);
+    for (uint64_t l = 0; l < lines; ++l)
+        buf[l * stride] = l;
+
+    XorShift64 rng(p.seed);
+    uint64_t sum = 0;
+    if (p.pattern == "cyclic") {
+        for (uint64_t i = 0; i < p.accesses; ++i)
+            sum += buf[(i % n) * stride];
+    } else if (p.pattern == "scan_hot") {
+        uint64_t s = 0;
+        for (uint64_t i = 0; i < p.accesses; ++i) {
+            if (i % (p.hotPerScan + 1) == p.hotPerScan)
+                sum += buf[(n + s++ % scan) * stride];
+            else
+                sum += buf[(rng.next() % n) * stride];
+        }
+    } else if (p.pattern == "zipf") {
+        for (uint64_t i = 0; i < p.accesses; ++i)
+            sum += buf[zipfRank(rng.uniform(), n, p.alpha) * stride];
+    } else if (p.pattern == "chase") {
+        randomCycle(buf.data(), n, stride, rng);
+        uint64_t pos = 0;
+        for (uint64_t i = 0; i < p.accesses; ++i) {
+            pos = buf[pos * stride];
+            sum += pos;
+        }
+    } else if (p.pattern == "phases") {
+        const uint64_t small = n / 4;
+        for (uint64_t i = 0; i < p.accesses; ++i) {
+            uint64_t k = i / phase, j = i % phase;
+            sum += buf[(k % 2 == 0 ? j % n : n + j % small) * stride];
+        }
+    } else {
+        std::fprintf(stderr, "Unknown pattern %s\n", p.pattern.c_str());
+        return 1;
+    }
+
+    std::printf("%s: footprint %" PRIu64 " lines of %" PRIu64 " B, %"
+                PRIu64 " accesses, seed %" PRIu64 ", checksum %" PRIu64
+                "\n", p.pattern.c_str(), n, p.line, p.accesses, p.seed,
+                sum);
+    return 0;
+}
@@ -0,0 +1,229 @@
+#!/usr/bin/env python3
+"""
+Trace replay model of the LRUIPVRP replacement policy.
+
+Replays a memory address trace through a single set-associative cache
+whose replacement follows the same rules as lru_ipv.cc:
+
+- hits promote the block to MRU;
+- misses fill an invalid way if one exists, otherwise evict the LRU way;
+- the filled block is inserted at MRU or at the LRU end, following the
+  IPV schedule (quantum*mru_pct/100 MRU inserts per quantum, placed
+  by the "front", "spread" or "stochastic" generator).
+
+This is much cheaper than a gem5 run and is meant for exploring the
+(mru_pct, quantum) space before confirming the best points in gem5.
+
+Accepted trace formats (optionally gzip-compressed):
+- one address per line, hex ("0x7ffd1230" or "7ffd1230") or decimal,
+  optionally preceded by an access type token ("R 0x1234", "W 0x1234");
+- gem5 debug output produced with --debug-flags=Cache, from which the
+  "<Cmd> [start:end]" packet descriptions are extracted.
+
+Example:
+    ./ipv_replay.py l2.trace --size 2MB --assoc 8 --mru-pct 25 --quantum 64
+"""
+
+import argparse
+import gzip
+import re
+import sys
+
+# gem5 "Cache" debug lines print packets as "ReadReq [4c0:4ff] ..."
+_GEM5_PKT_RE = re.compile(r'\b[A-Za-z]+(?:Req|Resp)\s+\[([0-9a-fA-F]+):')
+_ACCESS_TYPES = ('R', 'W', 'L', 'S', 'I', 'F', 'P')
+_SIZE_RE = re.compile(r'^\s*(\d+)\s*([kKmMgG]?)[iI]?[bB]?\s*$')
+
+
+def parse_size(text):
+    """Parse a gem5-style memory size such as "64kB" or "2MB"."""
+    if isinstance(text, int):
+        return text
+    m = _SIZE_RE.match(text)
+    if not m:
+        raise ValueError("Invalid size: %s" % text)
+    scale = {'': 1, 'k': 1 << 10, 'm': 1 << 20, 'g': 1 << 30}
+    return int(m.group(1)) * scale[m.group(2).lower()]
+
+
+def _parse_line(line):
+    m = _GEM5_PKT_RE.search(line)
+    if m:
+        return int(m.group(1), 16)
+    toks = line.split()
+    if not toks or toks[0].startswith('#'):
+        return None
+    tok = toks[1] if toks[0].upper() in _ACCESS_TYPES and len(toks) > 1 \
+        else toks[0]
+    tok = tok.rstrip(',')
+    try:
+        if tok.lower().startswith('0x') or not tok.isdigit():
+            return int(tok, 16)
+        return int(tok)
+    except ValueError:
+        return None
+
+
+def read_trace(path, block_size=64, limit=None):
+    """Read a trace and return the list of block addresses it touches."""
+    shift = block_size.bit_length() - 1
+    opener = gzip.open if path.endswith('.gz') else open
+    blocks = []
+    with opener(path, 'rt') as f:
+        for line in f:
+            addr = _parse_line(line)
+            if addr is None:
+                continue
+            blocks.append(addr >> shift)
+            if limit is not None and len(blocks) >= limit:
+                break
+    return blocks
+
+
+SCHEDULES = ('front', 'spread', 'stochastic')
+
+
+class XorShift64(object):
+    """Same generator as LRUIPVRP::nextRandom()."""
+
+    MASK = (1 << 64) - 1
+
+    def __init__(self, seed=1):
+        self.state = (seed or 0x9E3779B97F4A7C15) & self.MASK
+
+    def next(self):
+        x = self.state
+        x ^= (x << 13) & self.MASK
+        x ^= x >> 7
+        x ^= (x << 17) & self.MASK
+        self.state = x
+        return x
+
+
+def build_schedule(mru_pct, quantum, schedule='front', rng=None):
+    """IPV schedule as built by LRUIPVRP::buildSchedule()."""
+    quantum = max(1, quantum)
+    mru_count = max(0, min(quantum, (quantum * mru_pct) // 100))
+    if schedule == 'front':
+        return [1] * mru_count + [0] * (quantum - mru_count)
+    if schedule == 'spread':
+        return [(i + 1) * mru_count // quantum - i * mru_count // quantum
+                for i in range(quantum)]
+    if schedule == 'stochastic':
+        return [1 if rng.next() % 100 < mru_pct else 0
+                for _ in range(quantum)]
+    raise ValueError("Unknown schedule: %s" % schedule)
+
+
+class IPVCache(object):
+    """Set-associative cache managed by the LRU-IPV rules.
+
+    Each set keeps its resident blocks in recency order, index 0 being
+    the LRU block and the last index the MRU block.
+    """
+
+    def __init__(self, size, assoc, block_size=64, mru_pct=25, quantum=64,
+                 schedule='front', seed=1):
+        self.assoc = assoc
+        self.num_sets = max(1, parse_size(size) // (assoc * block_size))
+        self.mru_pct = mru_pct
+        self.schedule = schedule
+        self.rng = XorShift64(seed)
+        self.pv = build_schedule(mru_pct, quantum, schedule, self.rng)
+        self.ins_pos = 0
+        self.sets = [[] for _ in range(self.num_sets)]
+        self.accesses = 0
+        self.misses = 0
+        self.mru_inserts = 0
+
+    def access(self, block):
+        self.accesses += 1
+        order = self.sets[block % self.num_sets]
+        tag = block // self.num_sets
+        try:
+            order.remove(tag)
+        except ValueError:
+            self._fill(order, tag)
+            return False
+        order.append(tag)
+        return True
+
+    def _fill(self, order, tag):
+        self.misses += 1
+        if len(order) >= self.assoc:
+            del order[0]
+        insert_mru = self.pv[self.ins_pos] == 1
+        self.ins_pos = (self.ins_pos + 1) % len(self.pv)
+        if self.ins_pos == 0 and self.schedule == 'stochastic':
+            self.pv = build_schedule(self.mru_pct, len(self.pv),
+                                     self.schedule, self.rng)
+        if insert_mru:
+            self.mru_inserts += 1
+            order.append(tag)
+        else:
+            order.insert(0, tag)
+
+    def stats(self):
+        return {
+            'accesses': self.accesses,
+            'misses': self.misses,
+            'miss_rate': self.misses / float(max(1, self.accesses)),
+            'mru_inserts': self.mru_inserts,
+        }
+
+
+def replay(blocks, size, assoc, block_size=64, mru_pct=25, quantum=64,
+           limit=None, schedule='front', seed=1):
+    """Replay (a prefix of) a block trace and return the cache stats."""
+    cache = IPVCache(size, assoc, block_size, mru_pct, quantum, schedule,
+                     seed)
+    access = cache.access
+    if limit is None or limit >= len(blocks):
+        for b in blocks:
+            access(b)
+    else:
+        for i in range(limit):
+            access(blocks[i])
+    return cache.stats()
+
+
+def add_cache_options(parser):
+    parser.add_argument("--size", default="2MB",
+                        help="Cache size (default: 2MB, the L2 default)")
+    parser.add_argument("--assoc", type=int, default=8,
+                        help="Set associativity (default: 8)")
+    parser.add_argument("--block-size", type=int, default=64,
+                        help="Cache line size in bytes (default: 64)")
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Replay an address trace through an LRU-IPV cache model")
+    parser.add_argument("trace", help="Address trace (see module docstring)")
+    add_cache_options(parser)
+    parser.add_argument("--mru-pct", type=int, default=25,
+                        help="Percent of inserts done at MRU (0..100)")
+    parser.add_argument("--quantum", type=int, default=64,
+                        help="Schedule period length in inserts")
+    parser.add_argument("--schedule", choices=SCHEDULES, default='front',
+                        help="Placement of the MRU inserts in a quantum")
+    parser.add_argument("--seed", type=int, default=1,
+                        help="Seed of the stochastic schedule")
+    parser.add_argument("--limit", type=int, default=None,
+                        help="Only replay the first LIMIT accesses")
+    args = parser.parse_args()
+
+    blocks = read_trace(args.trace, args.block_size, args.limit)
+    if not blocks:
+        sys.exit("No addresses found in %s" % args.trace)
+    s = replay(blocks, args.size, args.assoc, args.block_size,
+               args.mru_pct, args.quantum, schedule=args.schedule,
+               seed=args.seed)
+    print("accesses    %d" % s['accesses'])
+    print("misses      %d" % s['misses'])
+    print("miss_rate   %.6f" % s['miss_rate'])
+    print("mru_inserts %d" % s['mru_inserts'])
+
+
+if __name__ == '__main__':
+    main()
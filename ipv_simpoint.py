@@ -0,0 +1,358 @@
+#!/usr/bin/env python3
+"""
+SimPoint-driven evaluation of replacement policies.
+
+Runs the whole SimPoint flow of gem5 for one workload and any number of
+replacement policies:
+
+1. profile: one atomic run with --simpoint-profile writes the basic block
+   vectors (BBVs) of every --interval instructions;
+2. cluster: the BBVs are clustered into representative intervals
+   (simulation points) and their weights, either by the SimPoint tool
+   (--simpoint-bin) or by the k-means/BIC clustering below, which
+   follows SimPoint 3: random projection to 15 dimensions, k-means for
+   k = 1..--max-k and the smallest k whose BIC reaches 90% of the
+   observed BIC range;
+3. checkpoint: one atomic run with --take-simpoint-checkpoints drops a
+   checkpoint --warmup instructions before every simulation point;
+4. run: every (policy, simulation point) pair restores its checkpoint
+   with --restore-simpoint-checkpoint and the policy given to
+   --repl_policy, all in parallel on the local cores;
+5. report: the stats of the measured interval of every run are combined
+   with the simulation point weights into one CPI and MPKI per policy.
+
+    ./ipv_simpoint.py --gem5 build/X86/gem5.opt --outdir sp.out \\
+        --policy LRURP --policy LRUIPVRP:mru_pct=10 -- \\
+        configs/example/se.py -c dijkstra -o input.dat \\
+        --caches --l2cache --cpu-type=DerivO3CPU
+
+Every stage reuses the outputs of a previous invocation found in
+--outdir, so adding a policy later only pays for its own runs. Use
+--redo to start over from a given stage; redoing any stage up to the
+checkpoints removes the old checkpoints and runs first.
+"""
+
+import argparse
+import gzip
+import json
+import math
+import os
+import random
+import re
+import shutil
+import subprocess
+import sys
+
+import ipv_gem5
+
+STAGES = ('profile', 'cluster', 'checkpoint', 'run')
+
+# Checkpoint directories written by --take-simpoint-checkpoints
+_CPT_RE = re.compile(r'cpt\.simpoint_(\d+)_inst_(\d+)_weight_([\d\.e\-]+)'
+                     r'_interval_(\d+)_warmup_(\d+)')
+
+
+def read_bbv(path):
+    """Basic block vectors of a simpoint.bb(.gz), one dict per interval."""
+    opener = gzip.open if path.endswith('.gz') else open
+    vectors = []
+    with opener(path, 'rt') as f:
+        for line in f:
+            if not line.startswith('T'):
+                continue
+            vec = {}
+            for tok in line[1:].split():
+                _, bb, count = tok.split(':')
+                vec[int(bb)] = vec.get(int(bb), 0) + int(count)
+            vectors.append(vec)
+    return vectors
+
+
+def project(vectors, dims=15, seed=1):
+    """Normalize every BBV and project it to dims random dimensions."""
+    rng = random.Random(seed)
+    basis = {}
+    points = []
+    for vec in vectors:
+        total = float(sum(vec.values())) or 1.0
+        p = [0.0] * dims
+        for bb, count in vec.items():
+            if bb not in basis:
+                basis[bb] = [rng.uniform(-1.0, 1.0) for _ in range(dims)]
+            w = count / total
+            for d, r in enumerate(basis[bb]):
+                p[d] += w * r
+        points.append(p)
+    return points
+
+
+def _dist2(a, b):
+    return sum((x - y) * (x - y) for x, y in zip(a, b))
+
+
+def kmeans(points, k, rng, iterations=100):
+    """k-means with k-means++ seeding; returns (centers, labels)."""
+    centers = [list(rng.choice(points))]
+    while len(centers) < k:
+        d2 = [min(_dist2(p, c) for c in centers) for p in points]
+        total = sum(d2)
+        if total == 0:
+            break
+        r = rng.uniform(0, total)
+        for p, d in zip(points, d2):
+            r -= d
+            if r <= 0:
+                centers.append(list(p))
+                break
+        else:
+            centers.append(list(points[-1]))
+
+    labels = None
+    for _ in range(iterations):
+        new = [min(range(len(centers)), key=lambda c: _dist2(p, centers[c]))
+               for p in points]
+        if new == labels:
+            break
+        labels = new
+        for c in range(len(centers)):
+            members = [p for p, l in zip(points, labels) if l == c]
+            if members:
+                centers[c] = [sum(x) / len(members) for x in zip(*members)]
+    return centers, labels
+
+
+def bic(points, centers, labels):
+    """Bayesian information criterion of a clustering (as in X-means)."""
+    n, dims, k = len(points), len(points[0]), len(centers)
+    sse = sum(_dist2(p, centers[l]) for p, l in zip(points, labels))
+    variance = max(sse / max(1, n - k), 1e-12)
+    likelihood = 0.0
+    for c in range(k):
+        size = labels.count(c)
+        if size == 0:
+            continue
+        likelihood += (size * math.log(size) - size * math.log(n) -
+                       size * dims / 2.0 * math.log(2 * math.pi * variance) -
+                       (size - k) / 2.0)
+    params = (k - 1) + dims * k + 1
+    return likelihood - params / 2.0 * math.log(n)
+
+
+def cluster(vectors, max_k=30, seed=1, threshold=0.9):
+    """Pick simulation points: returns [(interval, weight)], by interval."""
+    points = project(vectors, seed=seed)
+    rng = random.Random(seed)
+    runs = []
+    for k in range(1, min(max_k, len(points)) + 1):
+        centers, labels = kmeans(points, k, rng)
+        runs.append((bic(points, centers, labels), centers, labels))
+    scores = [r[0] for r in runs]
+    low, high = min(scores), max(scores)
+    score, centers, labels = next(
+        r for r in runs if r[0] >= low + threshold * (high - low))
+
+    picks = []
+    for c, center in enumerate(centers):
+        members = [i for i, l in enumerate(labels) if l == c]
+        if not members:
+            continue
+        rep = min(members, key=lambda i: _dist2(points[i], center))
+        picks.append((rep, len(members) / float(len(points))))
+    return sorted(picks)
+
+
+def write_simpoints(picks, simpoints_path, weights_path):
+    """Write picks in the format of the SimPoint tool (read by gem5)."""
+    with open(simpoints_path, 'w') as sp, open(weights_path, 'w') as w:
+        for cluster_id, (interval, weight) in enumerate(picks):
+            sp.write('%d %d\n' % (interval, cluster_id))
+            w.write('%.6f %d\n' % (weight, cluster_id))
+
+
+def checkpoints(ckpt_dir):
+    """SimPoint checkpoints in the order gem5 numbers them for -r.
+
+    Returns (number, directory, weight) tuples; number is 1-based.
+    """
+    dirs = sorted(d for d in os.listdir(ckpt_dir) if _CPT_RE.match(d))
+    return [(i + 1, d, float(_CPT_RE.match(d).group(3)))
+            for i, d in enumerate(dirs)]
+
+
+def combine(points, caches):
+    """Weighted CPI and MPKI of the runs of one policy.
+
+    points is a list of (weight, summary) pairs, summary being None for
+    failed runs, which are left out and reported through 'coverage'.
+    """
+    done = [(w, s) for w, s in points if s is not None]
+    total = sum(w for w, _ in done)
+    row = {'points': len(done), 'coverage': total}
+    keys = ['cpi'] + ['%s_mpki' % c.split('.')[-1] for c in caches]
+    for key in keys:
+        vals = [(w, s[key]) for w, s in done if s.get(key) is not None]
+        wsum = sum(w for w, _ in vals)
+        row[key] = sum(w * v for w, v in vals) / wsum if wsum else None
+    return row
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Profile, cluster, checkpoint and evaluate "
+        "replacement policies on SimPoint simulation points",
+        usage="%(prog)s [options] -- script.py [script options]")
+    parser.add_argument("--gem5", required=True, help="gem5 binary")
+    parser.add_argument("--policy", action="append", default=[],
+                        required=True, help="Replacement policy spec, as "
+                        "given to --repl_policy (repeat for each policy)")
+    parser.add_argument("--outdir", default="simpoint.out",
+                        help="Output directory (default: simpoint.out)")
+    parser.add_argument("--interval", type=int, default=10000000,
+                        help="Instructions per interval (default: 10M)")
+    parser.add_argument("--warmup", type=int, default=1000000,
+                        help="Warm-up instructions before every "
+                        "simulation point (default: 1M)")
+    parser.add_argument("--max-k", type=int, default=30,
+                        help="Largest number of clusters (default: 30)")
+    parser.add_argument("--seed", type=int, default=1,
+                        help="Seed of the projection and k-means")
+    parser.add_argument("--simpoint-bin", default=None,
+                        help="Cluster with this SimPoint 3 binary instead")
+    parser.add_argument("--fast-cpu", default="AtomicSimpleCPU",
+                        help="CPU model of the profile and checkpoint "
+                        "runs (default: AtomicSimpleCPU)")
+    parser.add_argument("--cache", action="append", default=None,
+                        help="Cache to report the MPKI of (default: "
+                        "system.l2)")
+    parser.add_argument("-j", "--jobs", type=int, default=None,
+                        help="Parallel runs (default: all cores)")
+    parser.add_argument("--redo", choices=STAGES, default=None,
+                        help="Redo this stage and the following ones")
+    parser.add_argument("--json", default=None,
+                        help="Also write the report to this file")
+    parser.add_argument("script", nargs=argparse.REMAINDER,
+                        help="Config script and its options, after --")
+    args = parser.parse_args()
+    ipv_gem5.check_specs(args.policy)
+
+    script_args = [a for a in args.script if a != '--']
+    if not script_args:
+        sys.exit("No config script given after --")
+    script, script_args = script_args[0], script_args[1:]
+    caches = args.cache or ['system.l2']
+    outdir = os.path.abspath(args.outdir)
+    redo = STAGES.index(args.redo) if args.redo else len(STAGES)
+
+    def stale(stage, output):
+        return STAGES.index(stage) >= redo or not os.path.exists(output)
+
+    def gem5(stage, extra):
+        run_dir = os.path.join(outdir, stage)
+        cmd = ipv_gem5.gem5_command(args.gem5, run_dir, script, script_args,
+                                    ['--cpu-type=%s' % args.fast_cpu] +
+                                    extra)
+        print("%s: %s" % (stage, run_dir))
+        if ipv_gem5.run(cmd, run_dir) != 0:
+            sys.exit("%s run failed, see %s" %
+                     (stage, os.path.join(run_dir, 'run.log')))
+
+    # Once a stage runs, everything derived from its old outputs is stale
+    rebuilt = False
+    bbv = os.path.join(outdir, 'profile', 'simpoint.bb.gz')
+    if stale('profile', bbv):
+        rebuilt = True
+        gem5('profile', ['--simpoint-profile',
+                         '--simpoint-interval=%d' % args.interval])
+
+    simpoints = os.path.join(outdir, 'simpoints')
+    weights = os.path.join(outdir, 'weights')
+    if rebuilt or stale('cluster', weights):
+        rebuilt = True
+        print("cluster: %s" % bbv)
+        if args.simpoint_bin:
+            subprocess.check_call([args.simpoint_bin, '-loadFVFile', bbv,
+                                   '-inputVectorsGzipped',
+                                   '-maxK', str(args.max_k),
+                                   '-saveSimpoints', simpoints,
+                                   '-saveSimpointWeights', weights])
+        else:
+            vectors = read_bbv(bbv)
+            if not vectors:
+                sys.exit("No basic block vectors in %s" % bbv)
+            write_simpoints(cluster(vectors, args.max_k, args.seed),
+                            simpoints, weights)
+
+    ckpt_dir = os.path.join(outdir, 'ckpt')
+    runs_dir = os.path.join(outdir, 'runs')
+    if rebuilt or stale('checkpoint', ckpt_dir) or not checkpoints(ckpt_dir):
+        # New checkpoints are numbered afresh: drop the old ones, which
+        # checkpoints() would list along, and the runs restored from them
+        for old in (ckpt_dir, runs_dir):
+            if os.path.exists(old):
+                shutil.rmtree(old)
+        gem5('checkpoint', ['--take-simpoint-checkpoints=%s,%s,%d,%d' %
+                            (simpoints, weights, args.interval, args.warmup),
+                            '--checkpoint-dir=%s' % ckpt_dir])
+    cpts = checkpoints(ckpt_dir)
+    print("%d simulation points" % len(cpts))
+
+    labels = ipv_gem5.unique_labels(args.policy)
+    jobs, keys = [], []
+    for spec, label in zip(args.policy, labels):
+        for num, _, weight in cpts:
+            run_dir = os.path.join(runs_dir, label, 'sp%d' % num)
+            stats_file = os.path.join(run_dir, 'stats.txt')
+            keys.append((spec, weight, stats_file))
+            if not stale('run', stats_file):
+                continue
+            jobs.append((ipv_gem5.gem5_command(
+                args.gem5, run_dir, script, script_args,
+                ['--checkpoint-dir=%s' % ckpt_dir,
+                 '--restore-simpoint-checkpoint',
+                 '--checkpoint-restore=%d' % num,
+                 '--restore-with-cpu=%s' % args.fast_cpu,
+                 '--repl_policy=%s' % spec]), run_dir))
+    print("run: %d of %d runs to do" % (len(jobs), len(keys)))
+    status = ipv_gem5.run_all(jobs, args.jobs, pin=True) if jobs else []
+    for (_, run_dir), code in zip(jobs, status):
+        if code != 0:
+            print("failed (status %d): %s" %
+                  (code, os.path.join(run_dir, 'run.log')))
+            # Leave no stats behind, so the next invocation retries it
+            stats_file = os.path.join(run_dir, 'stats.txt')
+            if os.path.exists(stats_file):
+                os.remove(stats_file)
+
+    rows = []
+    for spec in args.policy:
+        points = []
+        for s, weight, stats_file in keys:
+            if s != spec:
+                continue
+            summary = None
+            if os.path.exists(stats_file):
+                # The last dump covers the measured interval only
+                summary = ipv_gem5.summarize(
+                    ipv_gem5.read_stats(stats_file), caches)
+            points.append((weight, summary))
+        row = combine(points, caches)
+        row['policy'] = spec
+        rows.append(row)
+
+    columns = ['policy', 'cpi'] + \
+              ['%s_mpki' % c.split('.')[-1] for c in caches] + \
+              ['points', 'coverage']
+    print()
+    ipv_gem5.print_table(rows, columns)
+
+    if args.json:
+        with open(args.json, 'w') as f:
+            json.dump({'simpoints': [{'number': n, 'dir': d, 'weight': w}
+                                     for n, d, w in cpts],
+                       'policies': rows}, f, indent=2)
+    if any(status):
+        sys.exit(1)
+
+
+if __name__ == '__main__':
+    main()
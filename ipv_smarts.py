@@ -0,0 +1,200 @@
+#!/usr/bin/env python3
+"""
+SMARTS-style sampled evaluation of replacement policies.
+
+Each policy gets one gem5 run of the whole workload, in parallel on the
+local cores. The runs use --smarts (see Sampling.py): the atomic CPU
+keeps the caches and the policy state functionally warm and every
+--period instructions a short detailed window is simulated, --warmup
+instructions to warm up the pipeline and --measure measured ones. The
+measured windows are systematic samples of the workload, so their mean
+CPI and MPKI estimate those of a full detailed run, with a confidence
+interval given by their variance:
+
+    ./ipv_smarts.py --gem5 build/X86/gem5.opt \\
+        --policy LRURP --policy LRUIPVRP:mru_pct=10 \\
+        --period 1000000 --warmup 2000 --measure 1000 \\
+        --outdir smarts.out -- \\
+        configs/example/se.py -c dijkstra -o input.dat \\
+        --caches --l2cache
+
+Everything after "--" is the config script and its options; it must
+call Sampling.run_smarts() when --smarts is given, which the stock se.py
+and fs.py do not (see Sampling.py for the hook). The script and the
+config modules it imports are checked for the call before anything
+runs. LRUIPVRP policies are run with verbose_atomic=False, so the
+functional warming does not print a line per access.
+
+For each policy the table gives the number of windows, the mean CPI and
+MPKI of the caches given by --cache with the half width of their 95%
+confidence interval, and "windows_3pct", the number of windows SMARTS
+would need to bring the CPI within +-3% at 99.7% confidence.
+"""
+
+import argparse
+import json
+import math
+import os
+import sys
+
+import ipv_gem5
+import ipv_store
+
+# Two-sided 95% quantiles of Student's t, by degrees of freedom
+_T95 = [12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262,
+        2.228, 2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101,
+        2.093, 2.086, 2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052,
+        2.048, 2.045, 2.042]
+
+
+def mean_ci(samples):
+    """Mean, 95% confidence half width and coefficient of variation."""
+    samples = [s for s in samples if s is not None]
+    n = len(samples)
+    if n == 0:
+        return None, None, None
+    mean = sum(samples) / n
+    if n == 1:
+        return mean, None, None
+    sd = math.sqrt(sum((s - mean) ** 2 for s in samples) / (n - 1))
+    t = _T95[n - 2] if n - 2 < len(_T95) else 1.96
+    return mean, t * sd / math.sqrt(n), sd / mean if mean else None
+
+
+def windows(run_dir, caches):
+    """Per-window CPI and MPKI of one --smarts run."""
+    with open(os.path.join(run_dir, 'smarts.json')) as f:
+        params = json.load(f)
+    dumps = ipv_gem5.read_all_stats(os.path.join(run_dir, 'stats.txt'))
+    # Only the first dumps are windows, the last one is the exit dump
+    dumps = dumps[:params['windows']]
+    measure = float(params['measure'])
+    samples = []
+    for stats in dumps:
+        cycles = ipv_gem5.find_stat(stats,
+                                    r'system\.switch_cpus\d*\.numCycles')
+        sample = {'cpi': cycles / measure if cycles is not None else None}
+        for cache in caches:
+            misses = ipv_gem5.cache_misses(stats, cache)
+            sample['%s_mpki' % cache.split('.')[-1]] = (
+                1000.0 * misses / measure if misses is not None else None)
+        samples.append(sample)
+    return params, samples
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Evaluate replacement policies with SMARTS sampling",
+        usage="%(prog)s [options] -- script.py [script options]")
+    parser.add_argument("--gem5", required=True, help="gem5 binary")
+    parser.add_argument("--policy", action="append", default=[],
+                        required=True, help="Replacement policy spec, as "
+                        "given to --repl_policy (repeat for each policy)")
+    parser.add_argument("--period", type=int, default=1000000,
+                        help="Instructions between windows (default: 1M)")
+    parser.add_argument("--warmup", type=int, default=2000,
+                        help="Detailed warm-up instructions of a window "
+                        "(default: 2000)")
+    parser.add_argument("--measure", type=int, default=1000,
+                        help="Measured instructions of a window "
+                        "(default: 1000)")
+    parser.add_argument("--max-windows", type=int, default=None,
+                        help="Stop every run after this many windows")
+    parser.add_argument("--detailed-cpu", default="DerivO3CPU",
+                        help="CPU model of the windows (default: "
+                        "DerivO3CPU)")
+    parser.add_argument("--outdir", default="smarts.out",
+                        help="Output directory (default: smarts.out)")
+    parser.add_argument("--cache", action="append", default=None,
+                        help="Cache to report the MPKI of (default: "
+                        "system.l2)")
+    parser.add_argument("-j", "--jobs", type=int, default=None,
+                        help="Parallel runs (default: all cores)")
+    parser.add_argument("--no-pin", action="store_true",
+                        help="Do not pin every run to its own core")
+    parser.add_argument("--json", default=None,
+                        help="Also write the per-window samples and the "
+                        "summary to this file")
+    parser.add_argument("script", nargs=argparse.REMAINDER,
+                        help="Config script and its options, after --")
+    args = parser.parse_args()
+    ipv_gem5.check_specs(args.policy)
+
+    script = [a for a in args.script if a != '--'][:1]
+    script_args = [a for a in args.script if a != '--'][1:]
+    if not script:
+        sys.exit("No config script given after --")
+    if not ipv_gem5.calls_sampling(script[0], 'run_smarts'):
+        sys.exit("%s does not call Sampling.run_smarts(), so it would "
+                 "ignore --smarts and run the whole workload on the "
+                 "atomic CPU. Hook it in where the script calls "
+                 "Simulation.run():\n\n"
+                 "    if options.smarts:\n"
+                 "        Sampling.run_smarts(options, root, system)\n"
+                 "    else:\n"
+                 "        Simulation.run(options, root, system, "
+                 "FutureClass)" % script[0])
+    caches = args.cache or ['system.l2']
+    metrics = ['cpi'] + ['%s_mpki' % c.split('.')[-1] for c in caches]
+
+    smarts = ['--cpu-type=AtomicSimpleCPU',
+              '--smarts=%d,%d,%d' % (args.period, args.warmup, args.measure),
+              '--smarts-cpu=%s' % args.detailed_cpu]
+    if args.max_windows:
+        smarts.append('--smarts-windows=%d' % args.max_windows)
+
+    outdir = os.path.abspath(args.outdir)
+    labels = ipv_gem5.unique_labels(args.policy)
+    jobs = []
+    for spec, label in zip(args.policy, labels):
+        run_dir = os.path.join(outdir, label)
+        quiet = ipv_gem5.with_param(spec, 'LRUIPVRP', 'verbose_atomic',
+                                    False)
+        jobs.append((ipv_gem5.gem5_command(
+            args.gem5, run_dir, script[0], script_args,
+            smarts + ['--repl_policy=%s' % quiet]), run_dir))
+    print("Sampling %d policies, one window every %d instructions" %
+          (len(jobs), args.period))
+    status = ipv_gem5.run_all(jobs, args.jobs, pin=not args.no_pin)
+
+    rows, runs = [], []
+    for spec, (_, run_dir), code in zip(args.policy, jobs, status):
+        row = {'policy': spec, 'status': code}
+        if code != 0:
+            print("%s failed (status %d), see %s" %
+                  (spec, code, os.path.join(run_dir, 'run.log')))
+            rows.append(row)
+            continue
+        if not os.path.exists(os.path.join(run_dir, 'smarts.json')):
+            print("%s ran no SMARTS windows (no smarts.json), see %s" %
+                  (spec, os.path.join(run_dir, 'run.log')))
+            row['status'] = 'no windows'
+            rows.append(row)
+            continue
+        params, samples = windows(run_dir, caches)
+        row['windows'] = len(samples)
+        for metric in metrics:
+            mean, ci, cv = mean_ci([s[metric] for s in samples])
+            row[metric] = mean
+            row[metric + '_ci'] = ci
+            if metric == 'cpi' and cv is not None:
+                row['windows_3pct'] = int(math.ceil((3 * cv / 0.03) ** 2))
+        rows.append(row)
+        runs.append({'policy': spec, 'dir': run_dir, 'params': params,
+                     'samples': samples})
+
+    columns = ['policy', 'windows'] + \
+              [c for m in metrics for c in (m, m + '_ci')] + \
+              ['windows_3pct']
+    print()
+    ipv_gem5.print_table(rows, columns)
+
+    if args.json:
+        with open(args.json, 'w') as f:
+            json.dump({'summary': rows, 'runs': runs}, f, indent=2)
+    if any(row['status'] != 0 for row in rows):
+        sys.exit(1)
+
+
+if __name__ == '__main__':
+    main()
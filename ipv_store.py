@@ -0,0 +1,206 @@
+#!/usr/bin/env python3
+"""
+Content-addressed store of gem5 run results.
+
+A run is identified by what determines its outcome: its command line
+(the config script options) and the contents of every file the command
+names, which covers the gem5 binary, the config script, the workload
+binary given to -c and input files given to -o or other options, and
+the config modules the script imports: every .py file under the configs
+directory holding the script (CacheConfig.py, Options.py, ...). Files
+count by content, not by path. The key of a run is a hash of all of
+these, so a rebuilt gem5, an edited config script or a new input gives
+new keys, while an unrelated change to a sweep leaves the keys of its
+other points alone.
+
+Records are JSON files holding the parsed stats of the run (last dump),
+the replacement policy of every cache, the command and the files that
+went into the key:
+
+    <root>/<key[:2]>/<key>.json
+
+File hashes are remembered by path, size and modification time in
+<root>/files.json, so large gem5 binaries are hashed once per build.
+
+    ./ipv_store.py ~/.cache/ipv-store            # list the records
+    ./ipv_store.py ~/.cache/ipv-store --show KEY # one record
+"""
+
+import argparse
+import hashlib
+import json
+import os
+import shlex
+import tempfile
+import threading
+
+
+def _write_json(path, data):
+    """Write data to path atomically, so readers never see half a file."""
+    directory = os.path.dirname(path)
+    if not os.path.isdir(directory):
+        os.makedirs(directory, exist_ok=True)
+    fd, tmp = tempfile.mkstemp(dir=directory, suffix='.tmp')
+    with os.fdopen(fd, 'w') as f:
+        json.dump(data, f, indent=1, sort_keys=True)
+    os.replace(tmp, path)
+
+
+def _candidates(arg):
+    """Strings of a command line argument that may name files."""
+    names = [arg]
+    if arg.startswith('-') and '=' in arg:
+        arg = arg.split('=', 1)[1]
+        names.append(arg)
+    for part in arg.split(';'):
+        try:
+            names += shlex.split(part)
+        except ValueError:
+            names += part.split()
+    return names
+
+
+def _normalize(arg, files):
+    """arg with the files it names replaced by their content hash."""
+    if arg in files:
+        return '@' + files[arg]
+    if arg.startswith('-') and '=' in arg:
+        option, value = arg.split('=', 1)
+        return option + '=' + _normalize(value, files)
+    if ';' in arg:
+        return ';'.join(_normalize(part, files) for part in arg.split(';'))
+    if any(name in files for name in arg.split()):
+        return ' '.join(_normalize(part, files) for part in arg.split())
+    return arg
+
+
+def config_root(script):
+    """Directory of the modules a config script imports.
+
+    The stock scripts put their configs/ directory on the path (for
+    configs/common and friends), so that is the nearest ancestor called
+    configs, or the script's own directory if there is none.
+    """
+    script_dir = os.path.dirname(os.path.abspath(script))
+    path = script_dir
+    while os.path.dirname(path) != path:
+        if os.path.basename(path) == 'configs':
+            return path
+        path = os.path.dirname(path)
+    return script_dir
+
+
+class ResultStore(object):
+    def __init__(self, root):
+        self.root = os.path.abspath(os.path.expanduser(root))
+        self._lock = threading.Lock()
+        self._files_path = os.path.join(self.root, 'files.json')
+        self._files = {}
+        if os.path.exists(self._files_path):
+            with open(self._files_path) as f:
+                self._files = json.load(f)
+
+    def file_hash(self, path):
+        """SHA-256 of a file's contents, cached by path, size and mtime."""
+        path = os.path.abspath(path)
+        st = os.stat(path)
+        stamp = [st.st_size, st.st_mtime_ns]
+        with self._lock:
+            known = self._files.get(path)
+            if known and known[0] == stamp:
+                return known[1]
+        h = hashlib.sha256()
+        with open(path, 'rb') as f:
+            for block in iter(lambda: f.read(1 << 20), b''):
+                h.update(block)
+        digest = h.hexdigest()
+        with self._lock:
+            self._files[path] = [stamp, digest]
+            _write_json(self._files_path, self._files)
+        return digest
+
+    def inputs(self, args):
+        """{path: content hash} of the files named by command arguments."""
+        files = {}
+        for arg in args:
+            for name in _candidates(arg):
+                if name not in files and os.path.isfile(name):
+                    files[name] = self.file_hash(name)
+        return files
+
+    def tree_hash(self, root):
+        """SHA-256 of the names and contents of the .py files under root."""
+        h = hashlib.sha256()
+        for directory, subdirs, names in os.walk(root):
+            subdirs.sort()
+            for name in sorted(names):
+                if name.endswith('.py'):
+                    path = os.path.join(directory, name)
+                    h.update(os.path.relpath(path, root).encode())
+                    h.update(self.file_hash(path).encode())
+        return h.hexdigest()
+
+    def key(self, args, script=None):
+        """Key of the run of a command (without --outdir).
+
+        Files enter the key by content only: the same binary or input
+        under another path gives the same key. With the config script
+        given, the modules it imports enter the key too (see
+        config_root()).
+        """
+        files = self.inputs(args)
+        normalized = [_normalize(arg, files) for arg in args]
+        if script:
+            root = config_root(script)
+            files[root + os.sep] = self.tree_hash(root)
+            normalized.append('@' + files[root + os.sep])
+        text = json.dumps(normalized)
+        return hashlib.sha256(text.encode()).hexdigest(), files
+
+    def _path(self, key):
+        return os.path.join(self.root, key[:2], key + '.json')
+
+    def get(self, key):
+        """Record of a key, None if the run is not in the store."""
+        try:
+            with open(self._path(key)) as f:
+                return json.load(f)
+        except (IOError, OSError, ValueError):
+            return None
+
+    def put(self, key, record):
+        record = dict(record, key=key)
+        _write_json(self._path(key), record)
+
+    def keys(self):
+        for sub in sorted(os.listdir(self.root)):
+            directory = os.path.join(self.root, sub)
+            if len(sub) != 2 or not os.path.isdir(directory):
+                continue
+            for name in sorted(os.listdir(directory)):
+                if name.endswith('.json'):
+                    yield name[:-len('.json')]
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="List or show the records of a result store")
+    parser.add_argument("root", help="Store directory")
+    parser.add_argument("--show", default=None, metavar="KEY",
+                        help="Print one record (a key prefix is enough)")
+    args = parser.parse_args()
+
+    store = ResultStore(args.root)
+    if args.show:
+        for key in store.keys():
+            if key.startswith(args.show):
+                print(json.dumps(store.get(key), indent=2, sort_keys=True))
+                return
+        raise SystemExit("No record %s in %s" % (args.show, store.root))
+    for key in store.keys():
+        record = store.get(key) or {}
+        print("%s  %s" % (key[:16], ' '.join(record.get('args', []))))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,347 @@
+#!/usr/bin/env python3
+"""
+Grid sweeps of gem5 runs for replacement policy studies.
+
+A sweep file (TOML, YAML or JSON) gives the gem5 binary, the config
+script with the options shared by every run, the workloads and a grid
+of config script options. Every combination of the grid values and the
+workloads is one gem5 run; all of them go through a job queue on the
+local cores, and the stats of every run are collected into one table:
+
+    ./ipv_sweep.py study.toml -j 16
+
+with study.toml:
+
+    gem5 = "build/X86/gem5.opt"
+    script = "configs/example/se.py"
+    args = ["--caches", "--l2cache", "--cpu-type=DerivO3CPU",
+            "--maxinsts=100000000"]
+    caches = ["system.l2"]          # MPKI columns (default: system.l2)
+    stats = ["system.cpu.ipc"]      # extra stat columns, regexes allowed
+    retries = 1                     # reruns of a failed run
+    timeout = 7200                  # seconds per run
+    mem_limit = "8GB"               # address space per run
+
+    [grid]                          # option name = list of values
+    repl_policy = ["LRURP", "LRUIPVRP:mru_pct=10"]
+    l1d_size = ["32kB", "64kB"]
+    l2_size = ["1MB", "2MB", "4MB"]
+    l2_assoc = [8, 16]
+
+    [workloads]                     # name = options selecting it
+    dijkstra = ["-c", "dijkstra", "-o", "input.dat"]
+    qsort = ["-c", "qsort", "-o", "input_large.dat"]
+
+Grid entries become --<name>=<value> options, appended after args and
+the workload options so they take precedence. Entries whose value is a
+list of lists are used as is, e.g.
+prefetch = [[], ["--l2-hwp-type=StridePrefetcher"]], and booleans are
+flags given or left out, e.g. l2_shadow = [false, true]. The specs of
+every *_repl, repl_policy and shadow_policy option are checked before
+anything runs.
+
+Every run has its own directory, outdir/runs/<workload>/<key>, where key
+is a hash of its command line: points keep their directory when the grid
+grows, and runs that already completed are not repeated (--redo repeats
+them). Completed runs are also recorded in a result store shared by all
+sweeps (see ipv_store.py), keyed by the command line and the contents of
+the gem5 binary, config script and the config modules it imports,
+workload binary and input files. A point found in the store is not run
+at all, whichever sweep recorded it, until one of these changes; a
+completed run of the outdir is only reused while its store key matches
+too. The table of all points is written to outdir/results.csv, one
+column per axis, metric and extra stat, with the source of its stats
+(run, outdir or store), and printed unless --quiet.
+"""
+
+import argparse
+import csv
+import hashlib
+import itertools
+import json
+import os
+import sys
+
+import ipv_gem5
+import ipv_replay
+import ipv_store
+
+
+def load_sweep(path):
+    """Sweep description of a TOML, YAML or JSON file, as a dict."""
+    ext = os.path.splitext(path)[1].lower()
+    if ext == '.toml':
+        try:
+            import tomllib
+        except ImportError:
+            import toml as tomllib
+        with open(path, 'rb') as f:
+            return tomllib.load(f)
+    if ext in ('.yaml', '.yml'):
+        import yaml
+        with open(path) as f:
+            return yaml.safe_load(f)
+    with open(path) as f:
+        return json.load(f)
+
+
+def _option(name, value):
+    if isinstance(value, list):
+        return [str(v) for v in value]
+    if isinstance(value, bool):
+        # Flags: true passes --<name>, false leaves it out
+        return ['--%s' % name] if value else []
+    return ['--%s=%s' % (name, value)]
+
+
+def expand(sweep):
+    """Points of a sweep: (workload, {axis: value}, script options)."""
+    grid = sweep.get('grid') or {}
+    axes = list(grid)
+    for axis in axes:
+        if not isinstance(grid[axis], list) or not grid[axis]:
+            sys.exit("grid.%s must be a non-empty list" % axis)
+    workloads = sweep.get('workloads') or {'-': []}
+    points = []
+    for workload, workload_args in workloads.items():
+        for values in itertools.product(*(grid[a] for a in axes)):
+            script_args = list(sweep.get('args', [])) + list(workload_args)
+            for axis, value in zip(axes, values):
+                script_args += _option(axis, value)
+            points.append((workload, dict(zip(axes, values)), script_args))
+    return points
+
+
+def _takes_policy(name):
+    """Whether a config script option takes a replacement policy spec."""
+    return name.replace('-', '_').endswith(
+        ('_repl', 'repl_policy', 'shadow_policy'))
+
+
+def policy_specs(sweep):
+    """Specs the sweep gives to options ending in _repl, repl_policy or
+    shadow_policy, in its grid, args and workloads."""
+    specs, args = [], list(sweep.get('args', []))
+    for workload_args in (sweep.get('workloads') or {}).values():
+        args += workload_args
+    for axis, values in (sweep.get('grid') or {}).items():
+        for value in values:
+            if isinstance(value, list):
+                args += [str(v) for v in value]
+            elif _takes_policy(axis) and not isinstance(value, bool):
+                specs.append(str(value))
+    for i, arg in enumerate(args):
+        name, eq, value = arg.partition('=')
+        if not name.startswith('--') or not _takes_policy(name[2:]):
+            continue
+        if eq:
+            specs.append(value)
+        elif i + 1 < len(args):
+            specs.append(args[i + 1])
+    return specs
+
+
+def point_key(script, script_args):
+    """Short hash of the command line of a point."""
+    text = json.dumps([script] + script_args)
+    return hashlib.sha1(text.encode()).hexdigest()[:12]
+
+
+def completed_key(run_dir):
+    """Store key of the completed run in run_dir, None if there is none.
+
+    A run whose key differs from that of its point now was made with
+    another gem5 build, config module or input, and cannot be reused.
+    """
+    try:
+        with open(os.path.join(run_dir, 'point.json')) as f:
+            return json.load(f).get('key')
+    except (IOError, OSError, ValueError):
+        return None
+
+
+def load_record(run_dir):
+    """Stats and cache policies of a completed run, for the store."""
+    stats_file = os.path.join(run_dir, 'stats.txt')
+    config_file = os.path.join(run_dir, 'config.ini')
+    if not os.path.exists(stats_file):
+        return None
+    return {'stats': ipv_gem5.read_stats(stats_file),
+            'policies': (ipv_gem5.read_policies(config_file)
+                         if os.path.exists(config_file) else None)}
+
+
+def _cell(value):
+    if isinstance(value, list):
+        return ' '.join(str(v) for v in value)
+    return value
+
+
+def _store(store, run, cmd):
+    # The outdir is not part of the run, leave it out of the record
+    store.put(run['key'], dict(run['record'], files=run['files'],
+                               args=[a for a in cmd
+                                     if not a.startswith('--outdir=')]))
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Run a grid of gem5 configurations on the local "
+        "cores and collect their stats into one table")
+    parser.add_argument("sweep", help="Sweep file (.toml, .yaml or .json)")
+    parser.add_argument("--outdir", default=None,
+                        help="Output directory (default: outdir of the "
+                        "sweep file, or <sweep name>.out)")
+    parser.add_argument("-j", "--jobs", type=int, default=None,
+                        help="Parallel runs (default: jobs of the sweep "
+                        "file, or all cores)")
+    parser.add_argument("--retries", type=int, default=None,
+                        help="Reruns of a failed run (default: retries "
+                        "of the sweep file, or 0)")
+    parser.add_argument("--timeout", type=float, default=None,
+                        help="Time limit of a run in seconds")
+    parser.add_argument("--mem-limit", default=None,
+                        help="Address space limit of a run, e.g. 8GB")
+    parser.add_argument("--no-pin", action="store_true",
+                        help="Do not pin every run to its own core")
+    parser.add_argument("--store", default=None,
+                        help="Result store shared by sweeps (default: "
+                        "store of the sweep file, or ~/.cache/ipv-store)")
+    parser.add_argument("--no-store", action="store_true",
+                        help="Neither look up nor record runs in the "
+                        "result store")
+    parser.add_argument("--redo", action="store_true",
+                        help="Rerun points that already completed or are "
+                        "in the store")
+    parser.add_argument("--dry-run", action="store_true",
+                        help="Print the gem5 commands without running them")
+    parser.add_argument("--quiet", action="store_true",
+                        help="Do not print the results table")
+    args = parser.parse_args()
+
+    sweep = load_sweep(args.sweep)
+    for key in ('gem5', 'script'):
+        if key not in sweep:
+            sys.exit("%s: no %s given" % (args.sweep, key))
+    grid = sweep.get('grid') or {}
+    ipv_gem5.check_specs(policy_specs(sweep))
+    caches = sweep.get('caches', ['system.l2'])
+    extra_stats = sweep.get('stats', [])
+    retries = args.retries if args.retries is not None \
+        else sweep.get('retries', 0)
+    timeout = args.timeout or sweep.get('timeout')
+    mem_limit = args.mem_limit or sweep.get('mem_limit')
+    if mem_limit is not None:
+        mem_limit = ipv_replay.parse_size(mem_limit)
+    outdir = os.path.abspath(
+        args.outdir or sweep.get('outdir') or
+        os.path.splitext(os.path.basename(args.sweep))[0] + '.out')
+
+    # Keys identify runs in the outdir too, so they are computed (and the
+    # file hashes cached) even when the store itself is not used
+    hasher = ipv_store.ResultStore(
+        args.store or sweep.get('store') or '~/.cache/ipv-store')
+    store = None if args.no_store else hasher
+
+    points = expand(sweep)
+    runs, jobs = [], []
+    for workload, axes, script_args in points:
+        run_dir = os.path.join(outdir, 'runs', workload,
+                               point_key(sweep['script'], script_args))
+        cmd = ipv_gem5.gem5_command(sweep['gem5'], run_dir,
+                                    sweep['script'], script_args)
+        run = {'workload': workload, 'axes': axes, 'dir': run_dir,
+               'status': None, 'attempts': 0, 'record': None}
+        runs.append(run)
+        run['key'], run['files'] = hasher.key(
+            [sweep['gem5'], sweep['script']] + script_args,
+            script=sweep['script'])
+        if args.redo:
+            pass
+        elif store and store.get(run['key']):
+            run['record'], run['source'] = store.get(run['key']), 'store'
+        elif completed_key(run_dir) == run['key']:
+            # Same command, gem5 build, config modules and inputs
+            run['record'], run['source'] = load_record(run_dir), 'outdir'
+            if store and run['record']:
+                _store(store, run, cmd)
+        if run['record']:
+            run['status'] = 0
+            continue
+        jobs.append((len(runs) - 1, cmd, run_dir))
+        if args.dry_run:
+            print(' '.join(cmd))
+        elif os.path.exists(os.path.join(run_dir, 'point.json')):
+            os.remove(os.path.join(run_dir, 'point.json'))
+    print("%d points, %d to run" % (len(runs), len(jobs)))
+    if args.dry_run:
+        return
+
+    def progress(index, status, attempt):
+        run = runs[jobs[index][0]]
+        run['status'], run['attempts'] = status, attempt
+        if status == 0:
+            # Marks the run as complete, its stats can be reused
+            with open(os.path.join(run['dir'], 'point.json'), 'w') as f:
+                json.dump({'workload': run['workload'],
+                           'axes': run['axes'], 'cmd': jobs[index][1],
+                           'key': run['key'], 'files': run['files']}, f,
+                          indent=2)
+            run['record'], run['source'] = load_record(run['dir']), 'run'
+            if store and run['record']:
+                _store(store, run, jobs[index][1])
+        finished = sum(r['status'] == 0 or r['attempts'] > retries
+                       for r in runs)
+        print("[%d/%d] %s %s: %s" %
+              (finished, len(runs), run['workload'],
+               ' '.join('%s=%s' % (a, _cell(v))
+                        for a, v in run['axes'].items()),
+               'ok' if status == 0 else
+               'failed (status %d, attempt %d)' % (status, attempt)))
+
+    if jobs:
+        ipv_gem5.run_all([(cmd, run_dir) for _, cmd, run_dir in jobs],
+                         args.jobs or sweep.get('jobs'),
+                         pin=not args.no_pin, retries=retries,
+                         timeout=timeout, mem_limit=mem_limit,
+                         progress=progress)
+
+    axes = list(grid)
+    metrics = ['insts', 'cpi'] + \
+              ['%s_%s' % (c.split('.')[-1], m) for c in caches
+               for m in ('policy', 'mpki')]
+    rows = []
+    for run in runs:
+        row = {'workload': run['workload'], 'status': run['status'],
+               'attempts': run['attempts'], 'source': run.get('source'),
+               'key': run.get('key'), 'dir': run['dir']}
+        row.update((a, _cell(v)) for a, v in run['axes'].items())
+        record = run['record'] if run['status'] == 0 else None
+        if record:
+            row.update(ipv_gem5.summarize(record['stats'], caches,
+                                          record['policies']))
+            for stat in extra_stats:
+                row[stat] = ipv_gem5.find_stat(record['stats'], stat)
+        rows.append(row)
+
+    columns = ['workload'] + axes + metrics + extra_stats + \
+              ['status', 'attempts', 'source', 'key', 'dir']
+    results = os.path.join(outdir, 'results.csv')
+    if not os.path.isdir(outdir):
+        os.makedirs(outdir)
+    with open(results, 'w', newline='') as f:
+        writer = csv.DictWriter(f, columns, extrasaction='ignore')
+        writer.writeheader()
+        writer.writerows(rows)
+    if not args.quiet:
+        print()
+        ipv_gem5.print_table(rows, columns[:-2])
+    failed = sum(r['status'] != 0 for r in rows)
+    print("Results of %d points in %s%s" %
+          (len(rows), results, ", %d failed" % failed if failed else ""))
+    if failed:
+        sys.exit(1)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,203 @@
+#!/usr/bin/env python3
+"""
+Synthetic access patterns for replacement policy evaluation.
+
+Generates the line sequences of the ipv_kernels.cc kernels, so that each
+pattern runs both in the replay model and in gem5:
+
+    # miss rates of a few policies in the replay model
+    ./ipv_workloads.py replay cyclic 2560kB --size 2MB --assoc 8 \\
+        --mru-pct 0,10,25,100
+
+    # trace for ipv_replay.py / ipv_autotune.py
+    ./ipv_workloads.py trace scan_hot 1MB -o scan_hot.trace.gz
+
+    # the same pattern in gem5
+    build/X86/gem5.opt configs/example/se.py -c ipv_kernels \\
+        -o "scan_hot 1MB 10000000" --caches --l2cache
+
+    # patterns and what to expect of them
+    ./ipv_workloads.py list
+
+The patterns, their parameters and the generator are those of
+ipv_kernels.cc (see there). Traces start at address 0, while the kernel
+reads a heap buffer whose physical placement depends on the simulated
+OS: the sequence of lines is identical, the mapping of lines to sets
+is the same up to the page placement.
+"""
+
+import argparse
+import gzip
+import math
+import sys
+import textwrap
+
+import ipv_replay
+
+# Pattern: (extra parameters and defaults, expected behavior)
+PATTERNS = {
+    'cyclic': ({}, "Loop over N lines. With N above the cache, LRU misses "
+               "on every access; IPV with a low mru_pct keeps part of the "
+               "loop and hits about (cache lines / N) of the time."),
+    'scan_hot': ({'scan': 0, 'hot_per_scan': 3},
+                 "hot_per_scan random accesses to N hot lines per line of "
+                 "a scan over scan (default 8N) lines used once. IPV keeps "
+                 "the hot set when it fits, LRU loses it to the scan."),
+    'zipf': ({'alpha': 0.99}, "Zipf(alpha) popular lines out of N. Recency "
+             "friendly: LRU does well and IPV should stay close to it."),
+    'chase': ({}, "Dependent loads along a random cycle over N lines. "
+              "Same reuse as cyclic without locality or memory level "
+              "parallelism, so misses show in the CPI."),
+    'phases': ({'phase': 0}, "Alternating phases (default accesses/8 "
+               "long) of cyclic over N lines and over N/4 other lines. The "
+               "first wants LRU insertion, the second MRU insertion; "
+               "mru_pct=0 never loads the small loop, adaptive tracks "
+               "both."),
+}
+
+
+def _zipf_rank(u, n, alpha):
+    if abs(alpha - 1.0) < 1e-9:
+        x = math.pow(n + 1.0, u)
+    else:
+        a = 1.0 - alpha
+        x = math.pow((math.pow(n + 1.0, a) - 1.0) * u + 1.0, 1.0 / a)
+    return min(int(x) - 1, n - 1)
+
+
+def lines(pattern, footprint, accesses, line=64, seed=1, **params):
+    """Line indices read by the ipv_kernels pattern, one per access."""
+    n = ipv_replay.parse_size(footprint) // line
+    if n < 4:
+        raise ValueError("Footprint too small")
+    rng = ipv_replay.XorShift64(seed)
+    if pattern == 'cyclic':
+        for i in range(accesses):
+            yield i % n
+    elif pattern == 'scan_hot':
+        scan = params.get('scan') or 8 * n
+        k = params.get('hot_per_scan', 3)
+        s = 0
+        for i in range(accesses):
+            if i % (k + 1) == k:
+                yield n + s % scan
+                s += 1
+            else:
+                yield rng.next() % n
+    elif pattern == 'zipf':
+        alpha = params.get('alpha', 0.99)
+        for _ in range(accesses):
+            u = (rng.next() >> 11) * (1.0 / 9007199254740992.0)
+            yield _zipf_rank(u, n, alpha)
+    elif pattern == 'chase':
+        succ = list(range(n))
+        for i in range(n - 1, 0, -1):
+            j = rng.next() % i
+            succ[i], succ[j] = succ[j], succ[i]
+        pos = 0
+        for _ in range(accesses):
+            yield pos
+            pos = succ[pos]
+    elif pattern == 'phases':
+        phase = params.get('phase') or max(1, accesses // 8)
+        small = n // 4
+        for i in range(accesses):
+            k, j = divmod(i, phase)
+            yield j % n if k % 2 == 0 else n + j % small
+    else:
+        raise ValueError("Unknown pattern: %s" % pattern)
+
+
+def write_trace(blocks, path=None, block_size=64):
+    """Write the addresses of line indices as a trace for read_trace().
+
+    path is gzipped if it ends in .gz; None writes to stdout.
+    """
+    out = sys.stdout
+    if path:
+        out = gzip.open(path, 'wt') if path.endswith('.gz') \
+            else open(path, 'w')
+    # With the 0x: read_trace() reads all-digit addresses as decimal
+    for block in blocks:
+        out.write('0x%x\n' % (block * block_size))
+    if path:
+        out.close()
+
+
+def _params(args):
+    """Pattern parameters given as name=value arguments."""
+    params = {}
+    for item in args.param:
+        name, _, value = item.partition('=')
+        defaults = PATTERNS[args.pattern][0]
+        if name not in defaults:
+            sys.exit("%s has no parameter %s (it has %s)" %
+                     (args.pattern, name,
+                      ', '.join(sorted(defaults)) or 'none'))
+        params[name] = type(defaults[name])(value)
+    return params
+
+
+def _blocks(args):
+    return lines(args.pattern, args.footprint, args.accesses,
+                 args.block_size, args.seed, **_params(args))
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Synthetic access patterns of ipv_kernels for the "
+        "replay model")
+    sub = parser.add_subparsers(dest='command')
+    sub.add_parser('list', help="List the patterns and their expected "
+                   "behavior")
+    for name, desc in (('trace', "Write the address trace of a pattern"),
+                       ('replay', "Miss rates of a pattern in the replay "
+                        "model")):
+        p = sub.add_parser(name, help=desc)
+        p.add_argument("pattern", choices=sorted(PATTERNS))
+        p.add_argument("footprint", help="Size of the N lines, e.g. 2560kB")
+        p.add_argument("--accesses", type=int, default=1000000,
+                       help="Accesses (default: 1000000)")
+        p.add_argument("--seed", type=int, default=1,
+                       help="Generator seed (default: 1)")
+        p.add_argument("--param", action="append", default=[],
+                       metavar="NAME=VALUE",
+                       help="Pattern parameter, see list")
+        if name == 'trace':
+            p.add_argument("--block-size", type=int, default=64,
+                           help="Line size in bytes (default: 64)")
+            p.add_argument("-o", "--output", default=None,
+                           help="Trace file, gzipped if it ends in .gz "
+                           "(default: stdout)")
+        else:
+            ipv_replay.add_cache_options(p)
+            p.add_argument("--mru-pct", default="0,25,100",
+                           help="Comma separated mru_pct values; 100 is "
+                           "LRU (default: 0,25,100)")
+            p.add_argument("--quantum", type=int, default=64,
+                           help="IPV quantum (default: 64)")
+    args = parser.parse_args()
+
+    if args.command == 'list':
+        for name in sorted(PATTERNS):
+            defaults, notes = PATTERNS[name]
+            extra = ', '.join('%s=%s' % kv for kv in sorted(defaults.items()))
+            print("%s%s" % (name, " (%s)" % extra if extra else ""))
+            print(textwrap.fill(notes, 79, initial_indent='    ',
+                                subsequent_indent='    '))
+    elif args.command == 'trace':
+        write_trace(_blocks(args), args.output, args.block_size)
+    elif args.command == 'replay':
+        blocks = list(_blocks(args))
+        for mru_pct in [int(v) for v in args.mru_pct.split(',')]:
+            stats = ipv_replay.replay(blocks, args.size, args.assoc,
+                                      args.block_size, mru_pct,
+                                      args.quantum)
+            print("mru_pct=%-3d miss rate %.6f (%d misses)" %
+                  (mru_pct, stats['miss_rate'], stats['misses']))
+    else:
+        parser.print_help()
+
+
+if __name__ == '__main__':
+    main()
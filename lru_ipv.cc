@@ -1,23 +1,80 @@
 #include "mem/cache/replacement_policies/lru_ipv.hh"
 
 #include <limits>
+#include <new>
 
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+#include "base/cprintf.hh"
+#include "base/intmath.hh"
 #include "base/logging.hh"
 #include "mem/cache/replacement_policies/replaceable_entry.hh"
+#include "mem/packet.hh"
+#include "mem/request.hh"
+#include "sim/system.hh"
 
 // ---------------- Small utilities ----------------
 
-void
-LRUIPVRP::ensureSet(uint32_t set) const
+IPVRecency::Kind
+LRUIPVRP::backendKind(const LRUIPVRPParams &p)
 {
-    auto &v = setAges[set];
-    if ((int)v.size() < numWays) {
-        v.resize(numWays, 0);
-        // Nice ascending initial state for first printouts
-        for (int i = 0; i < numWays; ++i) v[i] = i;
+    switch (p.backend) {
+      case Enums::age_vector:
+        return IPVRecency::Kind::AgeVector;
+      case Enums::linked_list:
+        return IPVRecency::Kind::LinkedList;
+      case Enums::bit_matrix:
+        return IPVRecency::Kind::BitMatrix;
+      case Enums::packed_nibble:
+        return IPVRecency::Kind::PackedNibble;
+      case Enums::perm_table:
+        return IPVRecency::Kind::PermTable;
+      case Enums::timestamp:
+        return IPVRecency::Kind::Timestamp;
+      case Enums::automatic:
+        // Fastest per associativity in lru_ipv_bench: the permutation
+        // tables up to 8 ways, timestamps up to 64 ways, the list once
+        // the victim argmin gets long
+        if (IPVRecency::supports(IPVRecency::Kind::PermTable, p.numWays))
+            return IPVRecency::Kind::PermTable;
+        if (p.numWays > (int)p.list_min_ways)
+            return IPVRecency::Kind::LinkedList;
+        return IPVRecency::Kind::Timestamp;
+      default:
+        panic("LRUIPVRP: unknown recency backend");
     }
 }
 
+int
+LRUIPVRP::findInvalidWay(uint32_t set) const
+{
+    const uint64_t *valid = validOf(set);
+    for (int w = 0; w < validWords; ++w) {
+        uint64_t free = ~valid[w];
+        if (w == validWords - 1 && (numWays % 64) != 0)
+            free &= (1ULL << (numWays % 64)) - 1;
+        if (free) return w * 64 + ctz64(free);
+    }
+    return -1;
+}
+
+ReplaceableEntry*
+LRUIPVRP::candidateAt(const ReplacementCandidates& candidates, int way)
+{
+    // Candidates come in way order from the tags; fall back to a search
+    // if they do not
+    if (way < (int)candidates.size() &&
+        (int)candidates[way]->getWay() == way) {
+        return candidates[way];
+    }
+    for (auto *e : candidates) {
+        if ((int)e->getWay() == way) return e;
+    }
+    return nullptr;
+}
+
 void
 LRUIPVRP::printAges(const std::vector<uint64_t>& v)
 {
@@ -28,51 +85,128 @@ LRUIPVRP::printAges(const std::vector<uint64_t>& v)
 }
 
 void
-LRUIPVRP::normalize(std::vector<uint64_t>& v)
+LRUIPVRP::printSet(uint32_t set) const
 {
-    // Stable sort indices by age, then relabel to 0..N-1
-    std::vector<int> idx(v.size());
-    for (size_t i = 0; i < v.size(); ++i) idx[i] = static_cast<int>(i);
-    std::stable_sort(idx.begin(), idx.end(),
-                     [&](int a, int b){ return v[a] < v[b]; });
-    uint64_t a = 0;
-    for (int i : idx) v[i] = a++;
+    recency->ranks(set, orderBuf);
+    printAges(orderBuf);
 }
 
-uint64_t
-LRUIPVRP::currentMRU(const std::vector<uint64_t>& v)
+bool
+LRUIPVRP::logging() const
 {
-    uint64_t m = 0;
-    for (auto x : v) m = std::max(m, x);
-    return m;
+    // Atomic mode means fast-forward or functional warming
+    return verbose && (verboseAtomic || !system->isAtomicMode());
 }
 
 uint64_t
-LRUIPVRP::promoteToMRU(std::vector<uint64_t>& v, int way)
+LRUIPVRP::nextRandom(InsertionState& st)
 {
-    const uint64_t old = v[way];
-    const uint64_t mru = currentMRU(v);
-    // Decrement entries that were newer than 'old' to keep order compact.
-    for (size_t i = 0; i < v.size(); ++i) {
-        if ((int)i == way) continue;
-        if (v[i] > old) v[i] -= 1;
+    // xorshift64 (Marsaglia)
+    st.rngState ^= st.rngState << 13;
+    st.rngState ^= st.rngState >> 7;
+    st.rngState ^= st.rngState << 17;
+    return st.rngState;
+}
+
+void
+LRUIPVRP::buildSchedule(InsertionState& st) const
+{
+    auto &pv = st.pv;
+    const int mru_count = std::max(0, std::min(quantum, (quantum * st.mruPct) / 100));
+    switch (schedule) {
+      case Enums::front:
+        // First (quantum*mruPct/100) are MRU inserts
+        std::fill(pv.begin(), pv.end(), 0);
+        for (int i = 0; i < mru_count; ++i) pv[i] = 1;
+        break;
+      case Enums::spread:
+        // Bresenham: slot i is MRU when the running count of MRU slots
+        // crosses an integer, giving gaps that differ by at most one
+        for (int i = 0; i < quantum; ++i) {
+            pv[i] = (int)(((int64_t)(i + 1) * mru_count) / quantum -
+                          ((int64_t)i * mru_count) / quantum);
+        }
+        break;
+      case Enums::stochastic:
+        // Independent Bernoulli(mruPct/100) draws
+        for (int i = 0; i < quantum; ++i)
+            pv[i] = (int)(nextRandom(st) % 100) < st.mruPct ? 1 : 0;
+        break;
+      default:
+        panic("LRUIPVRP: unknown insertion schedule");
     }
-    v[way] = mru;
-    // normalize(v);
-    return v[way];
 }
 
-uint64_t
-LRUIPVRP::insertNearLRU(std::vector<uint64_t>& v, int way)
+void
+LRUIPVRP::initState(InsertionState& st, uint64_t stream, int mru_pct) const
 {
-    // Put target at LRU (0) and bump others, then compact
-    for (size_t i = 0; i < v.size(); ++i) {
-        if ((int)i == way) continue;
-        v[i] += 1;
+    st.mruPct = mru_pct;
+    st.pv.assign(quantum, 0);
+    st.insPos = 0;
+    // Requestors draw from distinct, but still reproducible, streams
+    st.rngState = seed + stream * 0x9E3779B97F4A7C15ULL;
+    if (st.rngState == 0) st.rngState = 0x9E3779B97F4A7C15ULL;
+    buildSchedule(st);
+    recordMruPct(st);
+}
+
+LRUIPVRP::InsertionState&
+LRUIPVRP::stateFor(RequestorID id) const
+{
+    if (!perRequestor || id == Request::invldRequestorId)
+        return globalState;
+    if (id >= reqStates.size()) {
+        const size_t first = reqStates.size();
+        reqStates.resize(id + 1);
+        for (size_t i = first; i < reqStates.size(); ++i)
+            initState(reqStates[i], i + 1, initMruPct);
     }
-    v[way] = 0;
-    // normalize(v);
-    return v[way];
+    return reqStates[id];
+}
+
+void
+LRUIPVRP::recordMruPct(InsertionState& st) const
+{
+    auto &trace = st.mruPctTrace;
+    if (st.epochCount % st.traceStride != 0) return;
+    if ((int)trace.size() >= traceLength) {
+        // Out of slots: keep every other sample and halve the resolution
+        for (size_t i = 0; 2 * i < trace.size(); ++i)
+            trace[i] = trace[2 * i];
+        trace.resize((trace.size() + 1) / 2);
+        st.traceStride *= 2;
+        if (st.epochCount % st.traceStride != 0) return;
+    }
+    trace.push_back(st.mruPct);
+}
+
+void
+LRUIPVRP::endEpoch(InsertionState& st) const
+{
+    const double miss_rate =
+        static_cast<double>(st.epochInserts) /
+        static_cast<double>(st.epochInserts + st.epochHits);
+
+    // Hill climbing: keep moving while the miss rate improves, turn
+    // around when it gets worse or when a bound is reached.
+    if (st.lastMissRate >= 0.0 && miss_rate > st.lastMissRate)
+        st.adaptDir = -st.adaptDir;
+    int next = st.mruPct + st.adaptDir * mruPctStep;
+    if (next > maxMruPct || next < minMruPct) {
+        st.adaptDir = -st.adaptDir;
+        next = std::max(minMruPct, std::min(maxMruPct, next));
+    }
+    if (next != st.mruPct) {
+        st.mruPct = next;
+        buildSchedule(st);
+    }
+
+    st.lastMissRate = miss_rate;
+    st.epochInserts = 0;
+    st.epochHits = 0;
+    ++st.epochCount;
+    stats.adaptEpochs++;
+    recordMruPct(st);
 }
 
 // --------------- Policy implementation ----------------
@@ -80,88 +214,449 @@ LRUIPVRP::insertNearLRU(std::vector<uint64_t>& v, int way)
 LRUIPVRP::LRUIPVRP(const LRUIPVRPParams &p)
     : ReplacementPolicy::Base(p),
       numWays(p.numWays),
-      mruPct(p.mru_pct),
+      numSets(std::max<uint64_t>(1, p.cache_size /
+                                    (p.block_size * std::max(1, p.numWays)))),
       quantum(std::max(1, p.quantum)),
-      pv(quantum, 0),
-      insPos(0)
+      schedule(p.schedule),
+      initMruPct(p.adaptive ? std::max(p.min_mru_pct,
+                                       std::min(p.max_mru_pct, p.mru_pct))
+                            : p.mru_pct),
+      seed(p.seed ? p.seed : 0x9E3779B97F4A7C15ULL),
+      adaptive(p.adaptive),
+      epochLength(std::max<uint64_t>(1, p.epoch_length)),
+      minMruPct(p.min_mru_pct),
+      maxMruPct(p.max_mru_pct),
+      mruPctStep(std::max(1, p.mru_pct_step)),
+      traceLength(std::max(2, (int)p.trace_length & ~1)),
+      perRequestor(p.per_requestor),
+      system(p.system),
+      verbose(p.verbose),
+      verboseAtomic(p.verbose_atomic),
+      ship(p.ship),
+      shctMask(p.shct_entries - 1),
+      shctMax((1 << p.shct_bits) - 1),
+      pfMruPct(p.pf_mru_pct),
+      pfInsertPos(p.pf_insert_pos),
+      stats(*this),
+      recency(IPVRecency::create(backendKind(p), numSets, numWays,
+                                 p.list_anchors, p.deferred_hits)),
+      validWords((numWays + 63) / 64),
+      validBits((size_t)numSets * validWords, 0),
+      slab(allocateSlab((size_t)numSets * numWays, p.huge_pages))
 {
     fatal_if(numWays <= 0, "LRUIPVRP: numWays must be > 0");
-    // IPV schedule: first (quantum*mruPct/100) are MRU inserts
-    const int mru_count = std::max(0, std::min(quantum, (quantum * mruPct) / 100));
-    for (int i = 0; i < mru_count; ++i) pv[i] = 1;
+    fatal_if(p.deferred_hits > IPVRecency::Deferred::maxDepth,
+             "LRUIPVRP: deferred_hits must be at most %d",
+             IPVRecency::Deferred::maxDepth);
+    fatal_if(!recency, "LRUIPVRP: the %s backend does not support %d ways",
+             Enums::IPVBackendStrings[p.backend], numWays);
+    fatal_if(minMruPct > maxMruPct,
+             "LRUIPVRP: min_mru_pct must not exceed max_mru_pct");
+    fatal_if(!isPowerOf2(p.shct_entries) || p.shct_entries > (1 << 16),
+             "LRUIPVRP: shct_entries must be a power of 2 up to 65536");
+    fatal_if(p.shct_bits < 1 || p.shct_bits > 8,
+             "LRUIPVRP: shct_bits must be within 1..8");
+    fatal_if(pfMruPct < -1 || pfMruPct > 100,
+             "LRUIPVRP: pf_mru_pct must be -1 or within 0..100");
+    fatal_if(pfInsertPos < -1 || pfInsertPos >= numWays,
+             "LRUIPVRP: pf_insert_pos must be -1 or within 0..%d",
+             numWays - 1);
+
+    // Counters start weakly "reused": a signature has to see a dead
+    // eviction before its fills are sent to the LRU end
+    if (ship) shct.assign(p.shct_entries, 1);
+
+    const size_t blocks = (size_t)numSets * numWays;
+    if (perRequestor) blockRequestor.assign(blocks, Request::invldRequestorId);
+    if (ship) blockSignature.assign(blocks, 0);
+    metadataBytes = sizeof(IPVReplData) +
+        (double)(recency->bytesPerSet() + validWords * sizeof(uint64_t)) /
+            numWays +
+        (perRequestor ? sizeof(RequestorID) : 0) +
+        (ship ? sizeof(uint16_t) : 0);
+
+    initState(globalState, 0, initMruPct);
+    // Prefetch fills use their own stream; only demand fills adapt
+    if (pfMruPct >= 0)
+        initState(pfState, std::numeric_limits<RequestorID>::max() + 1ULL,
+                  pfMruPct);
+}
+
+LRUIPVRP::LRUIPVStats::LRUIPVStats(LRUIPVRP &_policy)
+    : Stats::Group(&_policy),
+      policy(_policy),
+      ADD_STAT(adaptEpochs, "Number of completed adaptation epochs"),
+      ADD_STAT(adaptMruPct, "MRU insertion percentage currently in use"),
+      ADD_STAT(adaptMruPctTrace, "MRU insertion percentage over time, one "
+               "slot every adaptTraceStride epochs"),
+      ADD_STAT(adaptTraceStride, "Adaptation epochs per adaptMruPctTrace "
+               "slot"),
+      ADD_STAT(insertions, "Number of insertions"),
+      ADD_STAT(mruInsertions, "Number of insertions done at MRU"),
+      ADD_STAT(mruFraction, "Realized fraction of MRU insertions"),
+      ADD_STAT(reqInsertions, "Number of insertions per requestor"),
+      ADD_STAT(reqMruInsertions, "Number of MRU insertions per requestor"),
+      ADD_STAT(reqHits, "Number of hits per requestor"),
+      ADD_STAT(reqMruFraction, "Realized fraction of MRU insertions per "
+               "requestor"),
+      ADD_STAT(reqMruPct, "MRU insertion percentage currently in use per "
+               "requestor (per_requestor only)"),
+      ADD_STAT(shipLiveInsertions, "Fills predicted reused by the SHCT "
+               "(inserted at MRU)"),
+      ADD_STAT(shipDeadInsertions, "Fills predicted dead by the SHCT "
+               "(inserted near LRU)"),
+      ADD_STAT(shipReReferenced, "Blocks re-referenced after insertion"),
+      ADD_STAT(shipDeadEvictions, "Blocks evicted without re-reference"),
+      ADD_STAT(pfInsertions, "Number of prefetch fills"),
+      ADD_STAT(pfMruInsertions, "Number of prefetch fills inserted at MRU"),
+      ADD_STAT(pfUseful, "Prefetched blocks promoted by a demand hit"),
+      ADD_STAT(pfEvictedUnused, "Prefetched blocks evicted before any "
+               "demand hit"),
+      ADD_STAT(pfAccuracy, "Fraction of prefetch fills that got a demand "
+               "hit"),
+      ADD_STAT(metadataBytesPerBlock, "Host bytes of replacement state per "
+               "cache block")
+{
+}
+
+void
+LRUIPVRP::LRUIPVStats::regStats()
+{
+    Stats::Group::regStats();
+
+    System *system = policy.system;
+    const auto max_requestors = system->maxRequestors();
+
+    adaptMruPct.scalar(policy.globalState.mruPct);
+    adaptMruPctTrace.init(policy.traceLength);
+
+    mruFraction.precision(4);
+    mruFraction = mruInsertions / insertions;
+
+    reqInsertions.init(max_requestors).flags(Stats::nozero);
+    reqMruInsertions.init(max_requestors).flags(Stats::nozero);
+    reqHits.init(max_requestors).flags(Stats::nozero);
+    reqMruPct.init(max_requestors).flags(Stats::nozero);
+    for (int i = 0; i < max_requestors; ++i) {
+        const std::string name = system->getRequestorName(i);
+        reqInsertions.subname(i, name);
+        reqMruInsertions.subname(i, name);
+        reqHits.subname(i, name);
+        reqMruFraction.subname(i, name);
+        reqMruPct.subname(i, name);
+    }
+    reqMruFraction.flags(Stats::nozero | Stats::nonan).precision(4);
+    reqMruFraction = reqMruInsertions / reqInsertions;
+
+    pfAccuracy.flags(Stats::nozero | Stats::nonan).precision(4);
+    pfAccuracy = pfUseful / pfInsertions;
+
+    metadataBytesPerBlock.scalar(policy.metadataBytes).precision(2);
+}
+
+void
+LRUIPVRP::LRUIPVStats::preDumpStats()
+{
+    Stats::Group::preDumpStats();
+
+    // The series is kept by the policy so it survives stat resets
+    const auto &st = policy.globalState;
+    for (int i = 0; i < policy.traceLength; ++i) {
+        adaptMruPctTrace[i] =
+            i < (int)st.mruPctTrace.size() ? st.mruPctTrace[i] : 0;
+    }
+    adaptTraceStride = st.traceStride;
+
+    const auto &req_states = policy.reqStates;
+    for (size_t i = 0; i < req_states.size() && i < reqMruPct.size(); ++i)
+        reqMruPct[i] = req_states[i].mruPct;
+}
+
+std::shared_ptr<LRUIPVRP::IPVReplData>
+LRUIPVRP::allocateSlab(size_t count, bool huge_pages)
+{
+    const size_t bytes = count * sizeof(IPVReplData);
+    void *mem = nullptr;
+    void *map_base = nullptr;
+    size_t map_len = 0;
+
+    if (huge_pages) {
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+        // Map one huge page more than needed and start at the first huge
+        // page boundary, which the kernel needs to back the range with
+        // huge pages
+        const size_t huge = 2 << 20;
+        map_len = (bytes + 2 * huge - 1) / huge * huge;
+        map_base = mmap(nullptr, map_len, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (map_base == MAP_FAILED) {
+            warn("LRUIPVRP: could not map %d bytes for the slab, using "
+                 "the heap", map_len);
+            map_base = nullptr;
+        } else {
+            const uintptr_t base = reinterpret_cast<uintptr_t>(map_base);
+            mem = reinterpret_cast<void *>((base + huge - 1) & ~(huge - 1));
+            if (madvise(mem, map_len - huge, MADV_HUGEPAGE) != 0)
+                warn("LRUIPVRP: huge pages unavailable for the slab");
+        }
+#else
+        warn("LRUIPVRP: huge_pages is not supported on this host");
+#endif
+    }
+    if (!mem) mem = ::operator new(bytes);
+
+    IPVReplData *data = static_cast<IPVReplData *>(mem);
+    for (size_t i = 0; i < count; ++i) new (&data[i]) IPVReplData();
+
+    return std::shared_ptr<IPVReplData>(data,
+        [count, map_base, map_len](IPVReplData *d) {
+            for (size_t i = 0; i < count; ++i) d[i].~IPVReplData();
+#if defined(__linux__)
+            if (map_base) {
+                munmap(map_base, map_len);
+                return;
+            }
+#endif
+            ::operator delete(d);
+        });
 }
 
 std::shared_ptr<ReplacementPolicy::ReplacementData>
 LRUIPVRP::instantiateEntry()
 {
-    return std::make_shared<IPVReplData>();
+    // The set and way of a block are derived from its slab position
+    fatal_if(slabUsed == (size_t)numSets * numWays,
+             "LRUIPVRP: more blocks than cache_size / (block_size * "
+             "numWays) = %u sets of %d ways", numSets, numWays);
+    // Aliasing constructor: no control block or allocation per entry
+    return std::shared_ptr<ReplacementPolicy::ReplacementData>(
+        slab, slab.get() + slabUsed++);
 }
 
 void
 LRUIPVRP::invalidate(const std::shared_ptr<ReplacementPolicy::ReplacementData>& rdata) const
 {
-    auto d = std::static_pointer_cast<IPVReplData>(rdata);
-    d->valid = false;
-    d->age = 0;
-    // set/way left as-is (harmless)
+    auto *d = static_cast<IPVReplData *>(rdata.get());
+    const size_t index = indexOf(*d);
+    const uint32_t set = index / numWays;
+    const int way = index % numWays;
+    if (!isValid(set, way)) return;
+
+    // The eviction of the victim, as opposed to other invalidations
+    retireVictim(*d);
+
+    // The invalid way becomes the next victim: drop it to the LRU end
+    // so the order of the remaining ways stays exact.
+    recency->insertLRU(set, way);
+    validOf(set)[way / 64] &= ~(1ULL << (way % 64));
+
+    // Invalidations are not evictions: do not train the SHCT on them
+    d->hasSignature = false;
+    d->prefetched = false;
+}
+
+RequestorID
+LRUIPVRP::requestorOf(const PacketPtr pkt)
+{
+    return (pkt && pkt->req) ? pkt->req->requestorId()
+                             : Request::invldRequestorId;
+}
+
+bool
+LRUIPVRP::isPrefetch(const PacketPtr pkt)
+{
+    return pkt && (pkt->cmd.isHWPrefetch() ||
+                   (pkt->req && pkt->req->isPrefetch()));
+}
+
+bool
+LRUIPVRP::signatureOf(const PacketPtr pkt, uint16_t& sig) const
+{
+    if (!pkt || !pkt->req || !pkt->req->hasPC()) return false;
+    const Addr pc = pkt->req->getPC();
+    // Fold the PC so that high bits also reach the table index
+    const int bits = floorLog2(shctMask + 1);
+    sig = static_cast<uint16_t>(((pc >> 2) ^ (pc >> (2 + bits)) ^
+                                 (pc >> (2 + 2 * bits))) & shctMask);
+    return true;
 }
 
 void
 LRUIPVRP::touch(const std::shared_ptr<ReplacementPolicy::ReplacementData>& rdata) const
 {
-    // Hit: promote to MRU and print transition
-    auto d = std::static_pointer_cast<IPVReplData>(rdata);
-    const uint32_t set = d->set;
-    const int      way = static_cast<int>(d->way);
+    auto *d = static_cast<IPVReplData *>(rdata.get());
+    touchBlock(*d, perRequestor ? blockRequestor[indexOf(*d)]
+                                : Request::invldRequestorId, false);
+}
 
-    ensureSet(set);
-    auto &v = setAges[set];
+void
+LRUIPVRP::touch(const std::shared_ptr<ReplacementPolicy::ReplacementData>& rdata,
+                const PacketPtr pkt)
+{
+    // The hit is accounted to whoever accesses the block, not to the
+    // requestor that brought it in
+    auto *d = static_cast<IPVReplData *>(rdata.get());
+    touchBlock(*d, requestorOf(pkt), isPrefetch(pkt));
+}
 
-    std::printf("\nIn touch.\n");
-    std::printf("\tSetID: %u\tindex: %d\n", set, way);
+void
+LRUIPVRP::touchBlock(IPVReplData& d, RequestorID requestor,
+                     bool prefetch) const
+{
+    // A prefetched block waits for its first demand hit to be promoted
+    if (d.prefetched) {
+        if (prefetch) return;
+        d.prefetched = false;
+        stats.pfUseful++;
+    }
+
+    // Hit: promote to MRU and print transition
+    const size_t index = indexOf(d);
+    const uint32_t set = index / numWays;
+    const int      way = index % numWays;
+
+    const bool log = logging();
+    if (log) {
+        std::printf("\nIn touch.\n");
+        std::printf("\tSetID: %u\tindex: %d\n", set, way);
+
+        std::printf("\told sharedState: ");
+        printSet(set);
+        std::printf("  New sharedState is: ");
+    }
 
-    std::printf("\told sharedState: ");
-    printAges(v);
-    std::printf("  New sharedState is: ");
+    recency->touch(set, way);
+    if (log) {
+        printSet(set);
+        std::printf(" \n");
+    }
 
-    promoteToMRU(v, way);
-    printAges(v);
-    std::printf(" \n");
+    if (d.hasSignature && !d.reReferenced) {
+        d.reReferenced = true;
+        uint8_t &ctr = shct[blockSignature[index]];
+        if (ctr < shctMax) ++ctr;
+        stats.shipReReferenced++;
+    }
 
-    d->age = v[way];
-    d->valid = true;
+    if (requestor < stats.reqHits.size()) stats.reqHits[requestor]++;
+    // The controller scores the demand miss rate, as its schedule only
+    // places demand fills: prefetch hits are left out like prefetch fills
+    if (adaptive && !prefetch) ++stateFor(requestor).epochHits;
 }
 
 void
 LRUIPVRP::reset(const std::shared_ptr<ReplacementPolicy::ReplacementData>& rdata) const
+{
+    auto *d = static_cast<IPVReplData *>(rdata.get());
+    // Refilled without an invalidation first: the victim leaves here
+    retireVictim(*d);
+    d->hasSignature = false;
+    d->prefetched = false;
+    resetBlock(*d, Request::invldRequestorId);
+}
+
+void
+LRUIPVRP::reset(const std::shared_ptr<ReplacementPolicy::ReplacementData>& rdata,
+                const PacketPtr pkt)
+{
+    auto *d = static_cast<IPVReplData *>(rdata.get());
+    retireVictim(*d);
+    uint16_t sig = 0;
+    d->hasSignature = ship && signatureOf(pkt, sig);
+    if (d->hasSignature) blockSignature[indexOf(*d)] = sig;
+    d->prefetched = isPrefetch(pkt);
+    resetBlock(*d, requestorOf(pkt));
+}
+
+void
+LRUIPVRP::resetBlock(IPVReplData& d, RequestorID requestor) const
 {
     // Insertion after miss: use IPV schedule (MRU vs near-LRU) and print
-    // NOTE: getVictim() already populated rdata->set/way correctly.
-    auto d = std::static_pointer_cast<IPVReplData>(rdata);
-    const uint32_t set = d->set;
-    const int      way = static_cast<int>(d->way);
+    const size_t index = indexOf(d);
+    const uint32_t set = index / numWays;
+    const int      way = index % numWays;
+    if (perRequestor) blockRequestor[index] = requestor;
+    InsertionState &st = stateFor(requestor);
+
+    const bool log = logging();
+    if (log) {
+        std::printf("\nIn reset.\n");
+        std::printf("\tSetID: %u\tindex: %d\n", set, way);
+
+        std::printf("\told sharedState: ");
+        printSet(set);
+        std::printf("  New sharedState is: ");
+    }
 
-    ensureSet(set);
-    auto &v = setAges[set];
+    bool insertMRU;
+    int insertPos = -1;
+    d.reReferenced = false;
+    if (d.prefetched && (pfInsertPos >= 0 || pfMruPct >= 0)) {
+        if (pfInsertPos >= 0) {
+            insertPos = pfInsertPos;
+            insertMRU = pfInsertPos == numWays - 1;
+        } else {
+            insertMRU = (pfState.pv[pfState.insPos] == 1);
+            pfState.insPos = (pfState.insPos + 1) % quantum;
+            if (pfState.insPos == 0 && schedule == Enums::stochastic)
+                buildSchedule(pfState);
+        }
+    } else if (d.hasSignature) {
+        // SHiP: a zero counter predicts the block dead on arrival
+        insertMRU = shct[blockSignature[index]] != 0;
+        if (insertMRU) stats.shipLiveInsertions++;
+        else stats.shipDeadInsertions++;
+    } else {
+        insertMRU = (st.pv[st.insPos] == 1);
+        st.insPos = (st.insPos + 1) % quantum;
+        // Stochastic schedules are redrawn every quantum
+        if (st.insPos == 0 && schedule == Enums::stochastic)
+            buildSchedule(st);
+    }
 
-    std::printf("\nIn reset.\n");
-    std::printf("\tSetID: %u\tindex: %d\n", set, way);
+    stats.insertions++;
+    if (insertMRU) stats.mruInsertions++;
+    if (d.prefetched) {
+        stats.pfInsertions++;
+        if (insertMRU) stats.pfMruInsertions++;
+    }
+    if (requestor < stats.reqInsertions.size()) {
+        stats.reqInsertions[requestor]++;
+        if (insertMRU) stats.reqMruInsertions[requestor]++;
+    }
 
-    std::printf("\told sharedState: ");
-    printAges(v);
-    std::printf("  New sharedState is: ");
+    if (insertPos >= 0) recency->insertAt(set, way, insertPos);
+    else if (insertMRU) recency->touch(set, way);
+    else recency->insertLRU(set, way);
 
-    const bool insertMRU = (pv[insPos] == 1);
-    insPos = (insPos + 1) % quantum;
+    if (log) {
+        printSet(set);
+        std::printf(" \n");
+    }
 
-    const uint64_t new_age = insertMRU ? promoteToMRU(v, way)
-                                       : insertNearLRU(v, way);
+    validOf(set)[way / 64] |= 1ULL << (way % 64);
 
-    printAges(v);
-    std::printf(" \n");
+    if (adaptive && !d.prefetched && ++st.epochInserts >= epochLength)
+        endEpoch(st);
+}
 
-    d->age = new_age;
-    d->valid = true;
+void
+LRUIPVRP::retireVictim(IPVReplData& d) const
+{
+    if (indexOf(d) != victimIndex) return;
+    victimIndex = noVictim;
+
+    // SHiP training: a block leaving without a hit was dead on arrival
+    if (d.hasSignature && !d.reReferenced) {
+        uint8_t &ctr = shct[blockSignature[indexOf(d)]];
+        if (ctr > 0) --ctr;
+        stats.shipDeadEvictions++;
+    }
+    d.hasSignature = false;
+    if (d.prefetched) {
+        stats.pfEvictedUnused++;
+        d.prefetched = false;
+    }
 }
 
 ReplaceableEntry*
@@ -173,45 +668,179 @@ LRUIPVRP::getVictim(const ReplacementCandidates& candidates) const
     auto *any_entry = candidates[0];
     const uint32_t set = any_entry->getSet();
 
-    // IMPORTANT: populate (set,way) into each candidate's rdata so that
-    // subsequent reset()/touch() have correct IDs without pointer tricks.
-    for (auto *e : candidates) {
-        auto d = std::static_pointer_cast<IPVReplData>(e->replacementData);
-        d->set = e->getSet();
-        d->way = e->getWay();
-        d->valid = true;
+    panic_if(set >= numSets, "LRUIPVRP: set %u out of range (%u sets)",
+             set, numSets);
+
+    // Fast path: fill the lowest invalid way
+    victimIndex = noVictim;
+    const int free_way = findInvalidWay(set);
+    if (free_way >= 0) {
+        ReplaceableEntry* victim = candidateAt(candidates, free_way);
+        if (victim) {
+            if (logging()) {
+                std::printf("In getVictim. SetID: %u\n", set);
+                std::printf("In getVictim. sharedState is: ");
+                printSet(set);
+                std::printf("\t Victim: %u\n", victim->getWay());
+            }
+            return victim;
+        }
     }
 
-    ensureSet(set);
-    auto &v = setAges[set];
+    // Choose LRU. The per-set order is authoritative: invalidations are
+    // reflected in it.
+    ReplaceableEntry* victim = candidateAt(candidates,
+                                           recency->lruWay(set));
+    if (!victim) victim = candidates[0];
 
-    // Warm-start sync: align our age vector with candidates' stored ages
-    for (auto *e : candidates) {
-        const int w = static_cast<int>(e->getWay());
-        if (w >= 0 && w < numWays) {
-            auto d = std::static_pointer_cast<IPVReplData>(e->replacementData);
-            if (d) v[w] = d->age;
-        }
+    // Trained on once the cache actually replaces it (retireVictim())
+    victimIndex = indexOf(
+        *static_cast<IPVReplData *>(victim->replacementData.get()));
+
+    // Required prints
+    if (logging()) {
+        std::printf("In getVictim. SetID: %u\n", set);
+        std::printf("In getVictim. sharedState is: ");
+        printSet(set);
+        std::printf("\t Victim: %u\n", victim->getWay());
     }
-    normalize(v);
 
-    // Choose LRU (minimal age)
-    ReplaceableEntry* victim = candidates[0];
-    uint64_t min_age = std::numeric_limits<uint64_t>::max();
-    for (auto *e : candidates) {
-        auto d = std::static_pointer_cast<IPVReplData>(e->replacementData);
-        if (d && d->age <= min_age) {
-            min_age = d->age;
-            victim = e;
+    return victim;
+}
+
+
+// --------------- Checkpointing ----------------
+
+void
+LRUIPVRP::serializeState(CheckpointOut &cp, const std::string &name,
+                         const InsertionState& st) const
+{
+    ScopedCheckpointSection sec(cp, name);
+    paramOut(cp, "mru_pct", st.mruPct);
+    arrayParamOut(cp, "pv", st.pv);
+    paramOut(cp, "ins_pos", st.insPos);
+    paramOut(cp, "rng_state", st.rngState);
+    paramOut(cp, "epoch_inserts", st.epochInserts);
+    paramOut(cp, "epoch_hits", st.epochHits);
+    paramOut(cp, "last_miss_rate", st.lastMissRate);
+    paramOut(cp, "adapt_dir", st.adaptDir);
+    arrayParamOut(cp, "mru_pct_trace", st.mruPctTrace);
+    paramOut(cp, "trace_stride", st.traceStride);
+    paramOut(cp, "epoch_count", st.epochCount);
+}
+
+void
+LRUIPVRP::unserializeState(CheckpointIn &cp, const std::string &name,
+                           InsertionState& st)
+{
+    ScopedCheckpointSection sec(cp, name);
+    paramIn(cp, "mru_pct", st.mruPct);
+    arrayParamIn(cp, "pv", st.pv);
+    fatal_if((int)st.pv.size() != quantum,
+             "LRUIPVRP: checkpointed schedule has %d slots, expected %d",
+             st.pv.size(), quantum);
+    paramIn(cp, "ins_pos", st.insPos);
+    paramIn(cp, "rng_state", st.rngState);
+    paramIn(cp, "epoch_inserts", st.epochInserts);
+    paramIn(cp, "epoch_hits", st.epochHits);
+    paramIn(cp, "last_miss_rate", st.lastMissRate);
+    paramIn(cp, "adapt_dir", st.adaptDir);
+    arrayParamIn(cp, "mru_pct_trace", st.mruPctTrace);
+    paramIn(cp, "trace_stride", st.traceStride);
+    paramIn(cp, "epoch_count", st.epochCount);
+}
+
+void
+LRUIPVRP::serialize(CheckpointOut &cp) const
+{
+    paramOut(cp, "num_sets", numSets);
+    paramOut(cp, "num_ways", numWays);
+
+    // The tags come back empty from a checkpoint, so the recency order,
+    // valid bits and per-block state would describe blocks that no
+    // longer exist; a restored cache refills its ways in way order
+    paramOut(cp, "per_requestor", perRequestor);
+    paramOut(cp, "ship", ship);
+    if (ship) arrayParamOut(cp, "shct", shct);
+
+    // Configuration the insertion states are only valid for
+    paramOut(cp, "quantum", quantum);
+    paramOut(cp, "schedule", (int)schedule);
+    paramOut(cp, "init_mru_pct", initMruPct);
+    paramOut(cp, "adaptive", adaptive);
+    paramOut(cp, "pf_mru_pct", pfMruPct);
+
+    serializeState(cp, "global_state", globalState);
+    if (pfMruPct >= 0) serializeState(cp, "pf_state", pfState);
+    paramOut(cp, "requestor_states", reqStates.size());
+    for (size_t i = 0; i < reqStates.size(); ++i)
+        serializeState(cp, csprintf("requestor_state%d", i), reqStates[i]);
+}
+
+void
+LRUIPVRP::unserialize(CheckpointIn &cp)
+{
+    uint32_t cpt_sets;
+    int cpt_ways;
+    // Checkpoints taken with another policy on this cache carry no state
+    if (!optParamIn(cp, "num_sets", cpt_sets, false)) {
+        inform("LRUIPVRP: no policy state in the checkpoint, starting "
+               "cold");
+        return;
+    }
+    paramIn(cp, "num_ways", cpt_ways);
+    fatal_if(cpt_sets != numSets || cpt_ways != numWays,
+             "LRUIPVRP: checkpoint has %u sets of %d ways, the cache has "
+             "%u sets of %d ways", cpt_sets, cpt_ways, numSets, numWays);
+
+    // The cache contents are not checkpointed: every way starts
+    // invalid, so fills take free ways first and no eviction of a block
+    // that was never brought back trains the SHCT or prefetch stats
+    std::fill(validBits.begin(), validBits.end(), 0);
+    victimIndex = noVictim;
+    const size_t blocks = (size_t)numSets * numWays;
+    for (size_t i = 0; i < blocks; ++i)
+        slab.get()[i] = IPVReplData();
+
+    bool cpt_per_requestor, cpt_ship;
+    paramIn(cp, "per_requestor", cpt_per_requestor);
+    paramIn(cp, "ship", cpt_ship);
+    if (cpt_ship && ship) {
+        std::vector<uint8_t> cpt_shct;
+        arrayParamIn(cp, "shct", cpt_shct);
+        if (cpt_shct.size() == shct.size()) {
+            for (size_t i = 0; i < shct.size(); ++i)
+                shct[i] = std::min(cpt_shct[i], shctMax);
+        } else {
+            warn("LRUIPVRP: checkpoint has %d SHCT entries, not %d; "
+                 "starting with a fresh SHCT", cpt_shct.size(), shct.size());
         }
     }
 
-    // Required prints
-    std::printf("In getVictim. SetID: %u\n", set);
-    std::printf("In getVictim. sharedState is: ");
-    printAges(v);
-    std::printf("\t Victim: %u\n", victim->getWay());
+    int cpt_quantum, cpt_schedule, cpt_mru_pct, cpt_pf_mru_pct;
+    bool cpt_adaptive;
+    paramIn(cp, "quantum", cpt_quantum);
+    paramIn(cp, "schedule", cpt_schedule);
+    paramIn(cp, "init_mru_pct", cpt_mru_pct);
+    paramIn(cp, "adaptive", cpt_adaptive);
+    paramIn(cp, "pf_mru_pct", cpt_pf_mru_pct);
+    if (cpt_quantum != quantum || cpt_schedule != (int)schedule ||
+        cpt_mru_pct != initMruPct || cpt_adaptive != adaptive) {
+        warn("LRUIPVRP: checkpoint taken with a different insertion "
+             "schedule; keeping the SHCT only");
+        return;
+    }
 
-    return victim;
+    unserializeState(cp, "global_state", globalState);
+    if (pfMruPct >= 0 && cpt_pf_mru_pct == pfMruPct)
+        unserializeState(cp, "pf_state", pfState);
+    if (perRequestor && cpt_per_requestor) {
+        size_t count;
+        paramIn(cp, "requestor_states", count);
+        if (count > 0) stateFor(count - 1);
+        for (size_t i = 0; i < count; ++i) {
+            unserializeState(cp, csprintf("requestor_state%d", i),
+                             reqStates[i]);
+        }
+    }
 }
-
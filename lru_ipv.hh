@@ -5,36 +5,104 @@
 #include <cstdint>
 #include <cstdio>
 #include <memory>
-#include <unordered_map>
 #include <vector>
 
+#include "base/statistics.hh"
+#include "base/types.hh"
+#include "enums/IPVBackend.hh"
+#include "enums/IPVSchedule.hh"
 #include "mem/cache/replacement_policies/base.hh"
+#include "mem/cache/replacement_policies/lru_ipv_recency.hh"
+#include "mem/packet.hh"
 #include "params/LRUIPVRP.hh"
+#include "sim/serialize.hh"
+
+class System;
 
 /**
  * LRUIPVRP — LRU with IPV-style insertion and verbose prints.
  *
  * Design:
- * - Each set has a compact "age" vector (size = numWays). After normalize(),
- *   ages are 0..N-1 with 0 = LRU and N-1 = MRU.
+ * - The recency order of every set is kept by a backend (see
+ *   lru_ipv_recency.hh): a compact age vector, a permutation of 0..N-1
+ *   with 0 = LRU and N-1 = MRU, or, for highly associative caches, an
+ *   index-linked list with O(1) promotion and LRU insertion, a bit
+ *   matrix, packed 4-bit ages, a single permutation state per set
+ *   updated by table lookups, or per-way timestamps. The automatic
+ *   choice takes the permutation tables up to 8 ways, timestamps up to
+ *   list_min_ways ways and the list above. Hit promotions can be
+ *   buffered per set (deferred_hits) and applied in one pass when the
+ *   victim is looked up or the set's order changes otherwise.
+ * - The per-block data of the whole cache comes from one contiguous,
+ *   set-major slab allocated at construction, optionally backed by
+ *   transparent huge pages (huge_pages).
+ * - Each set also has a valid bitmask. getVictim() returns the lowest
+ *   invalid way with a count-trailing-zeros; invalidate() clears the bit
+ *   and drops the way to the LRU end.
  * - touch(): promote to MRU.
  * - reset(): insert at MRU or near-LRU depending on an IPV schedule.
- * - getVictim(): choose min age (LRU).
+ *   The schedule holds quantum*mru_pct/100 MRU slots per quantum, either
+ *   all at the start of the quantum (front), evenly spread Bresenham
+ *   style (spread), or drawn from a seeded xorshift generator with
+ *   probability mru_pct, redrawn every quantum (stochastic).
+ * - getVictim(): choose an invalid way, or else the LRU way.
+ * - adaptive mode: every epoch of epoch_length insertions the miss rate
+ *   of the epoch is compared with the previous one and the MRU insertion
+ *   percentage is moved by mru_pct_step (hill climbing), reversing
+ *   direction whenever the miss rate got worse. The percentage stays
+ *   within [min_mru_pct, max_mru_pct].
+ * - per_requestor mode: the schedule and the adaptive controller are kept
+ *   per requestor ID (taken from the packet on reset() and remembered
+ *   per block), so a streaming core on a shared cache only
+ *   changes its own insertion behaviour.
+ * - ship mode: fills carrying a PC are inserted at MRU unless the
+ *   signature history counter of their PC hash is zero, in which case
+ *   they go near LRU. Counters are incremented on the first hit to a
+ *   block and decremented when a block is evicted without having been
+ *   re-referenced. getVictim() only remembers the victim: it is trained
+ *   on when the cache invalidates or refills it, so an allocation that
+ *   is abandoned after the victim was chosen trains nothing.
+ * - Every touch(), reset() and getVictim() prints the set's order
+ *   before and after (verbose). With verbose_atomic off the prints are
+ *   skipped while the memory system is in atomic mode, so fast-forward
+ *   and functional warming take the cheap path: no printing and no
+ *   order extraction from the backend.
+ * - prefetch fills (HW prefetch commands or requests flagged as
+ *   prefetches) can be inserted at a fixed recency position
+ *   (pf_insert_pos) or follow their own schedule (pf_mru_pct). A
+ *   prefetched block is only promoted by its first demand hit; hits from
+ *   other prefetches leave its position unchanged. Prefetch fills and
+ *   prefetch hits are not counted by the adaptive controller, which
+ *   scores the demand miss rate only.
+ *
+ * Per-block data:
+ * - The per-set stores (recency order, valid bits) are the only source
+ *   of truth. A block's set and way follow from its position in the
+ *   slab, so touch()/reset()/invalidate() need no lookup of the entry.
+ * - Only three flag bits live in the block. The filling requestor
+ *   (per_requestor) and PC signature (ship) are kept in per-block side
+ *   arrays, allocated only when their mode is enabled.
  *
- * Critical note (fixes constant SetID):
- * - We do NOT try to reconstruct ReplaceableEntry* from ReplacementData*.
- * - In getVictim() (where gem5 passes real entries), we record (set,way)
- *   into each candidate's metadata. Later, reset()/touch() read those fields.
+ * Checkpoints:
+ * - The classic tags come back empty from a checkpoint, so neither the
+ *   recency order nor anything per block is saved: after a restore every
+ *   way is invalid, the block flags and side arrays are cleared and the
+ *   sets refill in way order. Only the SHCT and the insertion states
+ *   (schedule cursor, generator and adaptive controller) carry over.
+ * - The insertion states are only restored when quantum, schedule,
+ *   mru_pct and adaptive match the checkpoint; otherwise the schedule
+ *   starts afresh and only the SHCT is kept.
  */
 class LRUIPVRP : public ReplacementPolicy::Base
 {
   public:
     struct IPVReplData : public ReplacementPolicy::ReplacementData
     {
-        uint64_t age = 0;     ///< Larger value == more recent (MRU)
-        bool     valid = false;
-        uint32_t set = 0;     ///< Cache set id (written in getVictim())
-        uint32_t way = 0;     ///< Way index within the set (written in getVictim())
+        IPVReplData() : hasSignature(0), reReferenced(0), prefetched(0) {}
+
+        uint8_t hasSignature : 1; ///< Fill carried a PC (ship)
+        uint8_t reReferenced : 1; ///< Hit since insertion (ship)
+        uint8_t prefetched : 1;   ///< Prefetch fill, no demand hit yet
     };
 
     explicit LRUIPVRP(const LRUIPVRPParams &p);
@@ -44,29 +112,213 @@ class LRUIPVRP : public ReplacementPolicy::Base
 
     void invalidate(const std::shared_ptr<ReplacementPolicy::ReplacementData>&) const override;
     void touch(const std::shared_ptr<ReplacementPolicy::ReplacementData>&) const override;
+    void touch(const std::shared_ptr<ReplacementPolicy::ReplacementData>&,
+               const PacketPtr pkt) override;
     void reset(const std::shared_ptr<ReplacementPolicy::ReplacementData>&) const override;
+    void reset(const std::shared_ptr<ReplacementPolicy::ReplacementData>&,
+               const PacketPtr pkt) override;
     ReplaceableEntry* getVictim(const ReplacementCandidates& candidates) const override;
 
+    void serialize(CheckpointOut &cp) const override;
+    void unserialize(CheckpointIn &cp) override;
+
   private:
     // ---- Config ----
     const int numWays;   ///< Set associativity
-    const int mruPct;    ///< % (0..100) of MRU insertions within a quantum
+    const uint32_t numSets; ///< Number of sets of the cache
     const int quantum;   ///< Schedule period length
+    const Enums::IPVSchedule schedule; ///< How MRU slots are placed in pv
+    const int initMruPct;         ///< mru_pct parameter
+    const uint64_t seed;          ///< Stochastic schedule seed
+
+    // ---- Adaptive insertion (hill climbing on the epoch miss rate) ----
+    const bool adaptive;          ///< Adjust mruPct at runtime
+    const uint64_t epochLength;   ///< Insertions per epoch
+    const int minMruPct;          ///< Lower bound for mruPct
+    const int maxMruPct;          ///< Upper bound for mruPct
+    const int mruPctStep;         ///< mruPct change per epoch
+    const int traceLength;        ///< Slots of the mruPct time series
+
+    // ---- Thread awareness ----
+    const bool perRequestor;      ///< One InsertionState per requestor
+    System *system;               ///< Used to name requestors in stats
+
+    // ---- Logging ----
+    const bool verbose;           ///< Print every policy operation
+    const bool verboseAtomic;     ///< Also print in atomic mode
+
+    /** Insertion schedule and adaptive controller state. */
+    struct InsertionState
+    {
+        /// % (0..100) of MRU insertions within a quantum
+        int mruPct = 0;
+
+        // IPV schedule: pv[i]==1 → insert MRU, 0 → insert near LRU
+        std::vector<int> pv;
+        int insPos = 0;
+        uint64_t rngState = 0;    ///< xorshift64 state (stochastic)
+
+        // Current epoch counters and controller state
+        uint64_t epochInserts = 0;
+        uint64_t epochHits = 0;
+        double lastMissRate = -1.0;
+        int adaptDir = 1;
+
+        // mruPct time series: slot i holds the value at epoch
+        // i*traceStride. When all slots are used, every other slot is
+        // dropped and the stride doubles, so the series always covers
+        // the whole run.
+        std::vector<int> mruPctTrace;
+        uint64_t traceStride = 1;
+        uint64_t epochCount = 0;
+    };
+
+    // ---- Signature-based insertion (SHiP) ----
+    const bool ship;              ///< Use the SHCT to pick the position
+    const uint32_t shctMask;      ///< SHCT entries - 1
+    const uint8_t shctMax;        ///< Saturation value of the counters
+    /// Signature history counter table, indexed by PC hash
+    mutable std::vector<uint8_t> shct;
+
+    // ---- Prefetch-aware insertion ----
+    const int pfMruPct;           ///< Prefetch schedule mru_pct, or -1
+    const int pfInsertPos;        ///< Fixed prefetch position, or -1
+    /// Schedule of prefetch fills (pfMruPct >= 0)
+    mutable InsertionState pfState;
+
+    /// State used without per_requestor, or for unknown requestors
+    mutable InsertionState globalState;
+    /// Per-requestor states, indexed by requestor ID (per_requestor)
+    mutable std::vector<InsertionState> reqStates;
+
+    struct LRUIPVStats : public Stats::Group
+    {
+        LRUIPVStats(LRUIPVRP &policy);
+
+        void regStats() override;
+        void preDumpStats() override;
+
+        const LRUIPVRP &policy;
+
+        /** Number of completed adaptation epochs */
+        Stats::Scalar adaptEpochs;
+        /** MRU insertion percentage currently in use */
+        Stats::Value adaptMruPct;
+        /** MRU insertion percentage over time (see mruPctTrace) */
+        Stats::Vector adaptMruPctTrace;
+        /** Epochs covered by each slot of adaptMruPctTrace */
+        Stats::Scalar adaptTraceStride;
+
+        /** Number of insertions */
+        Stats::Scalar insertions;
+        /** Number of insertions done at MRU */
+        Stats::Scalar mruInsertions;
+        /** Realized fraction of MRU insertions */
+        Stats::Formula mruFraction;
 
-    // IPV schedule: pv[i]==1 → insert MRU, 0 → insert near LRU
-    mutable std::vector<int> pv;
-    mutable int insPos = 0;
+        /** Per-requestor insertions, MRU insertions and hits */
+        Stats::Vector reqInsertions;
+        Stats::Vector reqMruInsertions;
+        Stats::Vector reqHits;
+        /** Per-requestor realized fraction of MRU insertions */
+        Stats::Formula reqMruFraction;
+        /** Per-requestor mruPct in use (per_requestor only) */
+        Stats::Vector reqMruPct;
+
+        /** Fills the SHCT predicted to be reused (inserted at MRU) */
+        Stats::Scalar shipLiveInsertions;
+        /** Fills the SHCT predicted dead (inserted near LRU) */
+        Stats::Scalar shipDeadInsertions;
+        /** Blocks re-referenced after insertion (SHCT increments) */
+        Stats::Scalar shipReReferenced;
+        /** Blocks evicted without re-reference (SHCT decrements) */
+        Stats::Scalar shipDeadEvictions;
+
+        /** Prefetch fills */
+        Stats::Scalar pfInsertions;
+        /** Prefetch fills inserted at MRU */
+        Stats::Scalar pfMruInsertions;
+        /** Prefetched blocks promoted by a demand hit */
+        Stats::Scalar pfUseful;
+        /** Prefetched blocks evicted before any demand hit */
+        Stats::Scalar pfEvictedUnused;
+        /** Fraction of prefetch fills that got a demand hit */
+        Stats::Formula pfAccuracy;
+
+        /** Host bytes of policy state per cache block */
+        Stats::Value metadataBytesPerBlock;
+    };
 
-    // Per-set age vectors (dense order 0..numWays-1)
-    mutable std::unordered_map<uint32_t, std::vector<uint64_t>> setAges;
+    mutable LRUIPVStats stats;
+
+    // Per-set recency order
+    const std::unique_ptr<IPVRecency::Backend> recency;
+    /// Scratch buffer for printing a set's order
+    mutable std::vector<uint64_t> orderBuf;
+
+    // Per-set valid bitmasks, validWords 64-bit words per set
+    const int validWords;
+    mutable std::vector<uint64_t> validBits;
+
+    // Per-block data of all numSets*numWays blocks in one contiguous
+    // slab. The tags instantiate entries set by set, way by way, so the
+    // slab is laid out set-major. Entries share the slab's ownership.
+    std::shared_ptr<IPVReplData> slab;
+    size_t slabUsed = 0;
+    static std::shared_ptr<IPVReplData> allocateSlab(size_t count,
+                                                     bool huge_pages);
+
+    /// Requestor that inserted each block (per_requestor only)
+    mutable std::vector<RequestorID> blockRequestor;
+    /// SHCT index of the PC that filled each block (ship only)
+    mutable std::vector<uint16_t> blockSignature;
+    static constexpr size_t noVictim = SIZE_MAX;
+    /// Slab index of the last valid way getVictim() chose, until it is
+    /// replaced; noVictim if there is none
+    mutable size_t victimIndex = noVictim;
+
+    /// Host bytes of policy state per cache block
+    double metadataBytes = 0;
 
     // ---- Helpers ----
-    void        ensureSet(uint32_t set) const;
+    static IPVRecency::Kind backendKind(const LRUIPVRPParams &p);
+    uint64_t*   validOf(uint32_t set) const
+    {
+        return &validBits[(size_t)set * validWords];
+    }
+    int         findInvalidWay(uint32_t set) const;
+    static ReplaceableEntry* candidateAt(
+        const ReplacementCandidates& candidates, int way);
+    /** Position of a block in the slab, set * numWays + way */
+    size_t      indexOf(const IPVReplData& d) const
+    {
+        return &d - slab.get();
+    }
+    bool        isValid(uint32_t set, int way) const
+    {
+        return (validOf(set)[way / 64] >> (way % 64)) & 1;
+    }
+    void        initState(InsertionState& st, uint64_t stream,
+                          int mru_pct) const;
+    InsertionState& stateFor(RequestorID id) const;
+    void        buildSchedule(InsertionState& st) const;
+    static uint64_t nextRandom(InsertionState& st);
+    void        endEpoch(InsertionState& st) const;
+    void        recordMruPct(InsertionState& st) const;
+    static RequestorID requestorOf(const PacketPtr pkt);
+    static bool isPrefetch(const PacketPtr pkt);
+    bool        signatureOf(const PacketPtr pkt, uint16_t& sig) const;
+    void        touchBlock(IPVReplData& d, RequestorID requestor,
+                           bool prefetch) const;
+    void        resetBlock(IPVReplData& d, RequestorID requestor) const;
+    void        retireVictim(IPVReplData& d) const;
+    void        serializeState(CheckpointOut &cp, const std::string &name,
+                               const InsertionState& st) const;
+    void        unserializeState(CheckpointIn &cp, const std::string &name,
+                                 InsertionState& st);
     static void printAges(const std::vector<uint64_t>& v);
-    static void normalize(std::vector<uint64_t>& v);
-    static uint64_t currentMRU(const std::vector<uint64_t>& v);
-    static uint64_t promoteToMRU(std::vector<uint64_t>& v, int way);
-    static uint64_t insertNearLRU(std::vector<uint64_t>& v, int way);
+    void        printSet(uint32_t set) const;
+    bool        logging() const;
 };
 
 #endif // __MEM_CACHE_REPLACEMENT_POLICIES_LRU_IPV_HH__
@@ -0,0 +1,471 @@
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "mem/cache/replacement_policies/lru_ipv.hh"
+#include "mem/cache/replacement_policies/lru_ipv_recency.hh"
+#include "mem/cache/replacement_policies/replaceable_entry.hh"
+#include "mem/packet.hh"
+#include "mem/request.hh"
+#include "sim/serialize.hh"
+
+namespace
+{
+
+const int Sets = 4;
+const int Ways = 4;
+
+/** Policy parameters of a 4-set, 4-way cache that inserts at MRU */
+LRUIPVRPParams
+makeParams(const std::string &name)
+{
+    LRUIPVRPParams p;
+    p.name = name;
+    p.eventq_index = 0;
+    p.numWays = Ways;
+    p.cache_size = Sets * Ways * 64;
+    p.block_size = 64;
+    p.backend = Enums::automatic;
+    p.list_min_ways = 64;
+    p.list_anchors = 4;
+    p.deferred_hits = 0;
+    p.huge_pages = false;
+    p.mru_pct = 100;
+    p.quantum = 64;
+    p.schedule = Enums::front;
+    p.seed = 1;
+    p.adaptive = false;
+    p.epoch_length = 4096;
+    p.min_mru_pct = 0;
+    p.max_mru_pct = 100;
+    p.mru_pct_step = 5;
+    p.trace_length = 64;
+    p.per_requestor = false;
+    p.system = nullptr;
+    p.verbose = false;
+    p.verbose_atomic = false;
+    p.ship = false;
+    p.shct_entries = 16384;
+    p.shct_bits = 3;
+    p.pf_mru_pct = -1;
+    p.pf_insert_pos = -1;
+    return p;
+}
+
+/** A policy with the blocks of its cache, instantiated as the tags do */
+struct Cache
+{
+    explicit Cache(const LRUIPVRPParams &p)
+        : params(p), policy(params), blks(Sets * Ways)
+    {
+        for (int b = 0; b < Sets * Ways; ++b) {
+            blks[b].setPosition(b / Ways, b % Ways);
+            blks[b].replacementData = policy.instantiateEntry();
+        }
+    }
+
+    ReplacementCandidates
+    candidates(int set)
+    {
+        ReplacementCandidates candidates;
+        for (int way = 0; way < Ways; ++way)
+            candidates.push_back(&blks[set * Ways + way]);
+        return candidates;
+    }
+
+    /** Fill a block into set and return the way it took */
+    int
+    fill(int set, const PacketPtr pkt = nullptr)
+    {
+        ReplaceableEntry *victim = policy.getVictim(candidates(set));
+        if (pkt)
+            policy.reset(victim->replacementData, pkt);
+        else
+            policy.reset(victim->replacementData);
+        return victim->getWay();
+    }
+
+    void
+    touch(int set, int way, const PacketPtr pkt = nullptr)
+    {
+        if (pkt)
+            policy.touch(blks[set * Ways + way].replacementData, pkt);
+        else
+            policy.touch(blks[set * Ways + way].replacementData);
+    }
+
+    void
+    invalidate(int set, int way)
+    {
+        policy.invalidate(blks[set * Ways + way].replacementData);
+    }
+
+    /** Value of key in a section of a checkpoint of the policy */
+    std::string
+    saved(const std::string &section, const std::string &key) const
+    {
+        std::ostringstream out;
+        {
+            ScopedCheckpointSection sec(out, "policy");
+            policy.serialize(out);
+        }
+        std::istringstream in(out.str());
+        const std::string header = "[policy" +
+            (section.empty() ? "" : "." + section) + "]";
+        bool in_section = false;
+        for (std::string line; std::getline(in, line); ) {
+            if (!line.empty() && line[0] == '[')
+                in_section = line == header;
+            else if (in_section && line.compare(0, key.size() + 1,
+                                                key + "=") == 0)
+                return line.substr(key.size() + 1);
+        }
+        return "";
+    }
+
+    /** SHCT counter of entry i, from the checkpoint */
+    int
+    shct(int i) const
+    {
+        std::istringstream in(saved("", "shct"));
+        int value = -1;
+        for (int k = 0; k <= i; ++k)
+            in >> value;
+        return value;
+    }
+
+    LRUIPVRPParams params;
+    LRUIPVRP policy;
+    std::vector<ReplaceableEntry> blks;
+};
+
+/** A demand read, or a hardware prefetch, of requestor at pc */
+struct Access
+{
+    Access(RequestorID requestor, Addr pc, bool prefetch = false)
+        : req(std::make_shared<Request>(0, 64, Request::Flags(), requestor,
+                                        pc, 0)),
+          pkt(req, prefetch ? MemCmd::HardPFReq : MemCmd::ReadReq)
+    {
+    }
+
+    RequestPtr req;
+    Packet pkt;
+};
+
+class NoResolver : public SimObjectResolver
+{
+  public:
+    SimObject *
+    resolveSimObject(const std::string &) override
+    {
+        return nullptr;
+    }
+};
+
+const IPVRecency::Kind Kinds[] = {
+    IPVRecency::Kind::AgeVector, IPVRecency::Kind::LinkedList,
+    IPVRecency::Kind::BitMatrix, IPVRecency::Kind::PackedNibble,
+    IPVRecency::Kind::PermTable, IPVRecency::Kind::Timestamp,
+};
+
+/**
+ * Apply the same random operations to a backend and to an AgeVector of
+ * the same geometry, and check that both keep the same order throughout.
+ */
+void
+checkAgainstAgeVector(IPVRecency::Kind kind, int ways, int anchors,
+                      int depth)
+{
+    const uint32_t sets = 3;
+    auto backend = IPVRecency::create(kind, sets, ways, anchors, depth);
+    if (!backend)
+        return;
+    IPVRecency::AgeVector reference(sets, ways);
+    SCOPED_TRACE(testing::Message() << backend->name() << ", " << ways
+                 << " ways, " << anchors << " anchors, depth " << depth);
+
+    std::mt19937 rng(ways * 1000 + anchors * 10 + depth);
+    std::vector<uint64_t> expected, actual, order(ways);
+    std::vector<uint16_t> touched(ways);
+    for (int op = 0; op < 2000; ++op) {
+        const uint32_t set = rng() % sets;
+        const int way = rng() % ways;
+        const int choice = rng() % 100;
+        if (choice < 45) {
+            backend->touch(set, way);
+            reference.touch(set, way);
+        } else if (choice < 60) {
+            // Near-LRU insertion, and the invalidation of a block
+            backend->insertLRU(set, way);
+            reference.insertLRU(set, way);
+        } else if (choice < 85) {
+            const int pos = rng() % ways;
+            backend->insertAt(set, way, pos);
+            reference.insertAt(set, way, pos);
+        } else if (choice < 92) {
+            // Distinct ways, at most as many as a deferred buffer holds
+            std::iota(touched.begin(), touched.end(), 0);
+            std::shuffle(touched.begin(), touched.end(), rng);
+            const int count = 1 + rng() % std::min(
+                ways, IPVRecency::Deferred::maxDepth);
+            backend->touchAll(set, touched.data(), count);
+            reference.touchAll(set, touched.data(), count);
+        } else if (choice < 95) {
+            std::iota(order.begin(), order.end(), 0);
+            std::shuffle(order.begin(), order.end(), rng);
+            backend->load(set, order);
+            reference.load(set, order);
+        }
+        // The deferred touches of a set must show in its ranks without
+        // an lruWay() folding them first
+        if (choice < 50 || op % 7 == 0) {
+            reference.ranks(set, expected);
+            backend->ranks(set, actual);
+            ASSERT_EQ(actual, expected) << "ranks of set " << set
+                                        << " after operation " << op;
+        }
+        ASSERT_EQ(backend->lruWay(set), reference.lruWay(set))
+            << "LRU way of set " << set << " after operation " << op;
+    }
+    for (uint32_t set = 0; set < sets; ++set) {
+        reference.ranks(set, expected);
+        backend->ranks(set, actual);
+        ASSERT_EQ(actual, expected) << "final ranks of set " << set;
+    }
+}
+
+} // anonymous namespace
+
+/**
+ * Every backend, plain and wrapped in a Deferred, must keep the exact
+ * order of the AgeVector reference at every width it supports; the
+ * LinkedList is also run with and without anchors.
+ */
+TEST(IPVRecencyTest, BackendsMatchAgeVector)
+{
+    for (const int ways : {1, 2, 7, 16, 64, 256}) {
+        for (const IPVRecency::Kind kind : Kinds) {
+            for (const int anchors : {0, 1, 4, 16}) {
+                if (anchors != 0 && kind != IPVRecency::Kind::LinkedList)
+                    continue;
+                for (const int depth :
+                     {0, 1, 4, IPVRecency::Deferred::maxDepth}) {
+                    checkAgainstAgeVector(kind, ways, anchors, depth);
+                    if (HasFatalFailure())
+                        return;
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Neither the cache contents nor the recency order are checkpointed, so
+ * after a restore every way must be free again: fills take the invalid
+ * ways first, in way order, whatever the order of the warm cache was.
+ */
+TEST(LRUIPVRPTest, RestoredCacheFillsInvalidWaysFirst)
+{
+    Cache warm(makeParams("warm"));
+    for (int set = 0; set < Sets; ++set) {
+        for (int way = 0; way < Ways; ++way)
+            ASSERT_EQ(warm.fill(set), way);
+    }
+    // Way 0 becomes MRU, so the LRU way of every set is way 1
+    for (int set = 0; set < Sets; ++set)
+        warm.touch(set, 0);
+    ASSERT_EQ(warm.fill(0), 1);
+
+    std::ostringstream out;
+    {
+        ScopedCheckpointSection sec(out, "policy");
+        warm.policy.serialize(out);
+    }
+
+    char dir_template[] = "/tmp/lru_ipv_test.XXXXXX";
+    const char *dir = mkdtemp(dir_template);
+    ASSERT_NE(dir, nullptr);
+    const std::string cpt_file =
+        std::string(dir) + "/" + CheckpointIn::baseFilename;
+    std::ofstream(cpt_file) << out.str();
+
+    NoResolver resolver;
+    CheckpointIn cp(dir, resolver);
+    Cache restored(makeParams("restored"));
+    {
+        ScopedCheckpointSection sec(cp, "policy");
+        restored.policy.unserialize(cp);
+    }
+    std::remove(cpt_file.c_str());
+    rmdir(dir);
+
+    for (int set = 0; set < Sets; ++set) {
+        for (int way = 0; way < Ways; ++way)
+            EXPECT_EQ(restored.fill(set), way);
+    }
+    // With every way valid again the order decides: the fills since the
+    // restore went to MRU in way order, so way 0 is the LRU way, not the
+    // warm cache's way 1
+    EXPECT_EQ(restored.fill(0), 0);
+}
+
+/**
+ * The controller steps mru_pct by mru_pct_step at the end of every
+ * epoch, keeps its direction while the miss rate does not get worse and
+ * reverses it when it does.
+ */
+TEST(LRUIPVRPTest, AdaptiveEpochStepsAndReverses)
+{
+    LRUIPVRPParams p = makeParams("adaptive");
+    p.adaptive = true;
+    p.mru_pct = 50;
+    p.mru_pct_step = 10;
+    p.epoch_length = 4;
+    Cache cache(p);
+
+    // First epoch, all misses: nothing to compare with, step up
+    for (int i = 0; i < 4; ++i)
+        cache.fill(0);
+    EXPECT_EQ(cache.saved("global_state", "mru_pct"), "60");
+
+    // Half of the accesses hit: better, keep going up
+    for (int i = 0; i < 4; ++i) {
+        cache.touch(0, i);
+        cache.fill(1);
+    }
+    EXPECT_EQ(cache.saved("global_state", "mru_pct"), "70");
+
+    // All misses again: worse, turn around
+    for (int i = 0; i < 4; ++i)
+        cache.fill(2);
+    EXPECT_EQ(cache.saved("global_state", "mru_pct"), "60");
+    EXPECT_EQ(cache.saved("global_state", "adapt_dir"), "-1");
+    EXPECT_EQ(cache.saved("global_state", "epoch_count"), "3");
+}
+
+/**
+ * With per_requestor, the fills of one requestor advance its own
+ * schedule and end its own epochs only.
+ */
+TEST(LRUIPVRPTest, PerRequestorSchedulesAreSeparate)
+{
+    LRUIPVRPParams p = makeParams("per_requestor");
+    p.per_requestor = true;
+    p.adaptive = true;
+    p.mru_pct = 50;
+    p.mru_pct_step = 10;
+    p.epoch_length = 4;
+    Cache cache(p);
+
+    Access first(1, 0x400), second(2, 0x800);
+    for (int i = 0; i < 4; ++i)
+        cache.fill(0, &first.pkt);
+    for (int i = 0; i < 3; ++i)
+        cache.fill(1, &second.pkt);
+
+    EXPECT_EQ(cache.saved("", "requestor_states"), "3");
+    EXPECT_EQ(cache.saved("requestor_state1", "mru_pct"), "60");
+    EXPECT_EQ(cache.saved("requestor_state1", "epoch_count"), "1");
+    EXPECT_EQ(cache.saved("requestor_state2", "mru_pct"), "50");
+    EXPECT_EQ(cache.saved("requestor_state2", "ins_pos"), "3");
+    EXPECT_EQ(cache.saved("requestor_state2", "epoch_inserts"), "3");
+    EXPECT_EQ(cache.saved("global_state", "epoch_count"), "0");
+    EXPECT_EQ(cache.saved("global_state", "ins_pos"), "0");
+}
+
+/**
+ * SHiP counters go up on the first hit to a block and down when a block
+ * leaves unreferenced, evicted or invalidated as a victim; fills of a
+ * signature at zero go near LRU.
+ */
+TEST(LRUIPVRPTest, ShipTrainsOnReuseAndDeadEviction)
+{
+    LRUIPVRPParams p = makeParams("ship");
+    p.ship = true;
+    p.shct_entries = 16;
+    Cache cache(p);
+
+    // With 16 entries, PC 4n hashes to entry n for n below 16
+    Access a(0, 4), b(0, 8);
+    for (int way = 0; way < Ways; ++way)
+        ASSERT_EQ(cache.fill(0, &a.pkt), way);
+    EXPECT_EQ(cache.shct(1), 1);
+    cache.touch(0, 0, &a.pkt);
+    cache.touch(0, 0, &a.pkt);
+    EXPECT_EQ(cache.shct(1), 2);
+
+    // Order 1, 2, 3, 0: ways 1 and 2 leave without a hit
+    ASSERT_EQ(cache.fill(0, &b.pkt), 1);
+    EXPECT_EQ(cache.shct(1), 1);
+    ASSERT_EQ(cache.policy.getVictim(cache.candidates(0))->getWay(), 2);
+    cache.invalidate(0, 2);
+    EXPECT_EQ(cache.shct(1), 0);
+    EXPECT_EQ(cache.shct(2), 1);
+
+    // A dead signature's fill is the next victim
+    ASSERT_EQ(cache.fill(0, &a.pkt), 2);
+    EXPECT_EQ(cache.fill(0, &b.pkt), 2);
+}
+
+/**
+ * A victim whose allocation is abandoned stays in the cache untrained:
+ * its first hit still counts as reuse. Invalidating another block than
+ * the victim is not an eviction either.
+ */
+TEST(LRUIPVRPTest, ShipIgnoresAbandonedVictims)
+{
+    LRUIPVRPParams p = makeParams("ship_abandoned");
+    p.ship = true;
+    p.shct_entries = 16;
+    Cache cache(p);
+
+    Access a(0, 4);
+    for (int way = 0; way < Ways; ++way)
+        ASSERT_EQ(cache.fill(0, &a.pkt), way);
+    ASSERT_EQ(cache.policy.getVictim(cache.candidates(0))->getWay(), 0);
+    EXPECT_EQ(cache.shct(1), 1);
+    cache.touch(0, 0, &a.pkt);
+    EXPECT_EQ(cache.shct(1), 2);
+
+    ASSERT_EQ(cache.policy.getVictim(cache.candidates(0))->getWay(), 1);
+    cache.invalidate(0, 3);
+    EXPECT_EQ(cache.shct(1), 2);
+}
+
+/**
+ * Prefetch fills go to pf_insert_pos. Prefetch hits leave them there and
+ * the first demand hit promotes them to MRU.
+ */
+TEST(LRUIPVRPTest, PrefetchInsertsAtPositionUntilDemandHit)
+{
+    LRUIPVRPParams p = makeParams("prefetch");
+    p.pf_insert_pos = 1;
+    Cache cache(p);
+
+    Access demand(0, 4), prefetch(0, 4, true);
+    for (int way = 0; way < Ways; ++way)
+        ASSERT_EQ(cache.fill(0, &demand.pkt), way);
+
+    // Way 0 refilled by a prefetch one above LRU: order 1, 0, 2, 3
+    ASSERT_EQ(cache.fill(0, &prefetch.pkt), 0);
+    cache.touch(0, 0, &prefetch.pkt);
+    EXPECT_EQ(cache.fill(0, &demand.pkt), 1);
+
+    // Order 0, 2, 3, 1 until the demand hit promotes way 0
+    cache.touch(0, 0, &demand.pkt);
+    EXPECT_EQ(cache.fill(0, &demand.pkt), 2);
+    EXPECT_EQ(cache.fill(0, &demand.pkt), 3);
+    EXPECT_EQ(cache.fill(0, &demand.pkt), 1);
+    EXPECT_EQ(cache.fill(0, &demand.pkt), 0);
+}
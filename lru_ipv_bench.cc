@@ -0,0 +1,147 @@
+/**
+ * Micro-benchmark of the LRUIPVRP recency backends (lru_ipv_recency.hh).
+ *
+ * Every backend supporting the associativity replays the same
+ * pre-generated operation stream, so the reported times only differ by
+ * the cost of the backend itself. The checksum of the victims must be
+ * the same for all backends of a row.
+ *
+ * Build from the gem5 source tree (no gem5 objects are needed):
+ *
+ *   g++ -O2 -std=c++14 -Isrc \
+ *       src/mem/cache/replacement_policies/lru_ipv_bench.cc \
+ *       src/mem/cache/replacement_policies/lru_ipv_recency.cc \
+ *       -o lru_ipv_bench
+ *
+ * Usage: lru_ipv_bench [ops] [sets] [hit_pct] [ways,ways,...] [defer]
+ *
+ * The stream models a cache with hit_pct% hits (promotions); misses look
+ * up the LRU way and insert there, one in four at MRU and the rest near
+ * LRU, like the default IPV schedule. A non-zero defer wraps every
+ * backend in a Deferred with that buffer depth; use few sets to model
+ * runs of hits to the same sets.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "mem/cache/replacement_policies/lru_ipv_recency.hh"
+
+using namespace IPVRecency;
+
+namespace
+{
+
+struct Op
+{
+    uint32_t set;
+    uint16_t way;
+    uint8_t kind;   ///< 0 touch, 1 miss + MRU insert, 2 miss + LRU insert
+};
+
+std::vector<Op>
+makeStream(size_t ops, uint32_t sets, int ways, int hit_pct)
+{
+    std::mt19937_64 rng(ways);
+    std::vector<Op> stream(ops);
+    for (auto &op : stream) {
+        op.set = rng() % sets;
+        // Skew hits towards few ways, as real reuse is
+        op.way = std::min<uint64_t>(ways - 1, (rng() % ways) * (rng() % 2));
+        const int r = rng() % 100;
+        op.kind = r < hit_pct ? 0 : (r - hit_pct) % 4 == 0 ? 1 : 2;
+    }
+    return stream;
+}
+
+double
+run(Backend &b, const std::vector<Op>& stream, uint64_t& checksum)
+{
+    const auto start = std::chrono::steady_clock::now();
+    uint64_t sum = 0;
+    for (const auto &op : stream) {
+        if (op.kind == 0) {
+            b.touch(op.set, op.way);
+        } else {
+            const int victim = b.lruWay(op.set);
+            sum = sum * 31 + victim;
+            if (op.kind == 1) b.touch(op.set, victim);
+            else b.insertLRU(op.set, victim);
+        }
+    }
+    const auto end = std::chrono::steady_clock::now();
+    checksum = sum;
+    return std::chrono::duration<double, std::nano>(end - start).count() /
+           stream.size();
+}
+
+} // anonymous namespace
+
+int
+main(int argc, char **argv)
+{
+    const size_t ops = argc > 1 ? std::strtoull(argv[1], nullptr, 0)
+                                : 20000000;
+    const uint32_t sets = argc > 2 ? std::strtoul(argv[2], nullptr, 0)
+                                   : 1024;
+    const int hit_pct = argc > 3 ? std::atoi(argv[3]) : 90;
+    std::vector<int> assocs = { 2, 4, 8, 16, 32, 64, 256, 1024 };
+    if (argc > 4) {
+        assocs.clear();
+        for (char *tok = std::strtok(argv[4], ","); tok;
+             tok = std::strtok(nullptr, ","))
+            assocs.push_back(std::atoi(tok));
+    }
+    const int defer = argc > 5 ? std::atoi(argv[5]) : 0;
+
+    const Kind kinds[] = { Kind::AgeVector, Kind::PackedNibble,
+                           Kind::BitMatrix, Kind::PermTable,
+                           Kind::Timestamp, Kind::LinkedList };
+
+    std::printf("%zu ops, %u sets, %d%% hits, defer %d; ns/op "
+                "(bytes/set)\n", ops, sets, hit_pct, defer);
+    std::printf("%6s", "ways");
+    for (Kind k : kinds)
+        std::printf(" %20s", create(k, 1, 2)->name());
+    std::printf("  fastest\n");
+
+    for (int ways : assocs) {
+        const auto stream = makeStream(ops, sets, ways, hit_pct);
+        std::printf("%6d", ways);
+        std::string fastest;
+        double best = 0;
+        uint64_t ref = 0;
+        bool first = true;
+        for (Kind k : kinds) {
+            if (!supports(k, ways)) {
+                std::printf(" %20s", "-");
+                continue;
+            }
+            auto b = create(k, sets, ways, 4, defer);
+            uint64_t checksum;
+            const double ns = run(*b, stream, checksum);
+            char cell[32];
+            std::snprintf(cell, sizeof(cell), "%.2f (%zu)", ns,
+                          b->bytesPerSet());
+            std::printf(" %20s", cell);
+            if (first) ref = checksum;
+            if (checksum != ref) {
+                std::printf("\n%s diverged from %s\n", b->name(),
+                            create(kinds[0], 1, 2)->name());
+                return 1;
+            }
+            if (first || ns < best) {
+                best = ns;
+                fastest = b->name();
+            }
+            first = false;
+        }
+        std::printf("  %s\n", fastest.c_str());
+    }
+    return 0;
+}
@@ -0,0 +1,889 @@
+#include "mem/cache/replacement_policies/lru_ipv_recency.hh"
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+#include <utility>
+
+namespace IPVRecency
+{
+
+constexpr int BitMatrix::maxWays;
+constexpr int PackedNibble::maxWays;
+constexpr int PermTable::maxWays;
+constexpr int Deferred::maxDepth;
+
+void
+Backend::touchAll(uint32_t set, const uint16_t* ways, int count)
+{
+    for (int i = 0; i < count; ++i) touch(set, ways[i]);
+}
+
+// ---------------- Age vector ----------------
+
+AgeVector::AgeVector(uint32_t num_sets, int num_ways)
+    : Backend(num_sets, num_ways), ages((size_t)num_sets * num_ways)
+{
+    // Nice ascending initial state for first printouts
+    for (uint32_t s = 0; s < numSets; ++s) {
+        uint16_t *v = row(s);
+        for (int i = 0; i < numWays; ++i) v[i] = i;
+    }
+}
+
+void
+AgeVector::touch(uint32_t set, int way)
+{
+    insertAt(set, way, numWays - 1);
+}
+
+void
+AgeVector::touchAll(uint32_t set, const uint16_t* ways, int count)
+{
+    // One pass: the other ways close the gaps left by the promoted ones,
+    // which take the count MRU positions in order
+    assert(count <= Deferred::maxDepth);
+    uint16_t *v = row(set);
+    uint16_t old[Deferred::maxDepth];
+    for (int k = 0; k < count; ++k) old[k] = v[ways[k]];
+    for (int i = 0; i < numWays; ++i) {
+        int older = 0;
+        for (int k = 0; k < count; ++k) older += old[k] < v[i];
+        v[i] -= older;
+    }
+    for (int k = 0; k < count; ++k) v[ways[k]] = numWays - count + k;
+}
+
+void
+AgeVector::insertAt(uint32_t set, int way, int pos)
+{
+    // Ages are always dense: close the gap left by 'way', then open one
+    // at 'pos'.
+    uint16_t *v = row(set);
+    const uint16_t old = v[way];
+    for (int i = 0; i < numWays; ++i) {
+        if (i == way) continue;
+        if (v[i] > old) v[i] -= 1;
+        if (v[i] >= pos) v[i] += 1;
+    }
+    v[way] = pos;
+}
+
+int
+AgeVector::lruWay(uint32_t set) const
+{
+    const uint16_t *v = row(set);
+    for (int i = 0; i < numWays; ++i) {
+        if (v[i] == 0) return i;
+    }
+    assert(false);
+    return 0;
+}
+
+void
+AgeVector::ranks(uint32_t set, std::vector<uint64_t>& out) const
+{
+    const uint16_t *v = row(set);
+    out.assign(v, v + numWays);
+}
+
+void
+AgeVector::load(uint32_t set, const std::vector<uint64_t>& ranks)
+{
+    std::copy(ranks.begin(), ranks.begin() + numWays, row(set));
+}
+
+size_t
+AgeVector::bytesPerSet() const
+{
+    return numWays * sizeof(uint16_t);
+}
+
+// ---------------- Linked list ----------------
+
+LinkedList::LinkedList(uint32_t num_sets, int num_ways, int num_anchors)
+    : Backend(num_sets, num_ways),
+      // Anchors need at least two positions between each other and the
+      // MRU end, so that one way can always be unlinked under them
+      numAnchors(std::max(0, std::min({num_anchors, num_ways / 2 - 1,
+                                       255}))),
+      prev((size_t)num_sets * num_ways),
+      next((size_t)num_sets * num_ways),
+      label((size_t)num_sets * num_ways),
+      head(num_sets), tail(num_sets),
+      anchor((size_t)num_sets * numAnchors)
+{
+    assert(num_ways < nil);
+    for (int k = 0; k < numAnchors; ++k)
+        anchorPos.push_back((k + 1) * numWays / (numAnchors + 1));
+
+    std::vector<uint64_t> identity(numWays);
+    for (int i = 0; i < numWays; ++i) identity[i] = i;
+    for (uint32_t s = 0; s < numSets; ++s) load(s, identity);
+}
+
+void
+LinkedList::unlink(uint32_t set, int way)
+{
+    const size_t i = idx(set, way);
+    uint16_t *anc = anchor.data() + (size_t)set * numAnchors;
+    const int l = label[i];
+
+    // An anchor on the way itself moves to its successor, which slides
+    // into the anchored position
+    if (l > 0 && anc[l - 1] == way) {
+        anc[l - 1] = next[i];
+        label[idx(set, next[i])] = l;
+    }
+    // Every anchor past the way slides one position towards LRU: the way
+    // it pointed to drops into the previous quantile and its successor
+    // takes over the anchored position
+    for (int k = l; k < numAnchors; ++k) {
+        const size_t x = idx(set, anc[k]);
+        label[x] = k;
+        anc[k] = next[x];
+        label[idx(set, anc[k])] = k + 1;
+    }
+
+    const uint16_t p = prev[i];
+    const uint16_t n = next[i];
+    if (p != nil) next[idx(set, p)] = n;
+    else head[set] = n;
+    if (n != nil) prev[idx(set, n)] = p;
+    else tail[set] = p;
+}
+
+int
+LinkedList::wayAt(uint32_t set, int pos) const
+{
+    // numWays-1 ways are linked: walk from the closest of the head, the
+    // tail and the last anchor at or before pos
+    const uint16_t *anc = anchor.data() + (size_t)set * numAnchors;
+    int from = head[set];
+    int steps = pos;
+    for (int k = numAnchors - 1; k >= 0; --k) {
+        if (anchorPos[k] <= pos) {
+            if (pos - anchorPos[k] < steps) {
+                from = anc[k];
+                steps = pos - anchorPos[k];
+            }
+            break;
+        }
+    }
+    const int back = numWays - 2 - pos;
+    if (back < steps) {
+        int w = tail[set];
+        for (int s = 0; s < back; ++s) w = prev[idx(set, w)];
+        return w;
+    }
+    int w = from;
+    for (int s = 0; s < steps; ++s) w = next[idx(set, w)];
+    return w;
+}
+
+void
+LinkedList::link(uint32_t set, int way, int pos)
+{
+    const int succ = pos < numWays - 1 ? wayAt(set, pos) : nil;
+    uint16_t *anc = anchor.data() + (size_t)set * numAnchors;
+
+    // Anchors past pos slide one position towards MRU, so the way just
+    // before each of them takes over its position
+    int l = 0;
+    for (int k = 0; k < numAnchors; ++k) {
+        if (anchorPos[k] > pos) {
+            anc[k] = prev[idx(set, anc[k])];
+            label[idx(set, anc[k])] = k + 1;
+        } else {
+            if (anchorPos[k] == pos) anc[k] = way;
+            l = k + 1;
+        }
+    }
+
+    const size_t i = idx(set, way);
+    label[i] = l;
+    if (succ == nil) {
+        const uint16_t t = tail[set];
+        prev[i] = t;
+        next[i] = nil;
+        if (t != nil) next[idx(set, t)] = way;
+        else head[set] = way;
+        tail[set] = way;
+    } else {
+        const size_t j = idx(set, succ);
+        const uint16_t p = prev[j];
+        prev[i] = p;
+        next[i] = succ;
+        prev[j] = way;
+        if (p != nil) next[idx(set, p)] = way;
+        else head[set] = way;
+    }
+}
+
+void
+LinkedList::touch(uint32_t set, int way)
+{
+    if (tail[set] == way) return;
+    unlink(set, way);
+    link(set, way, numWays - 1);
+}
+
+void
+LinkedList::insertAt(uint32_t set, int way, int pos)
+{
+    unlink(set, way);
+    link(set, way, pos);
+}
+
+void
+LinkedList::insertLRU(uint32_t set, int way)
+{
+    if (head[set] == way) return;
+    unlink(set, way);
+    link(set, way, 0);
+}
+
+int
+LinkedList::lruWay(uint32_t set) const
+{
+    return head[set];
+}
+
+void
+LinkedList::ranks(uint32_t set, std::vector<uint64_t>& out) const
+{
+    out.resize(numWays);
+    uint64_t r = 0;
+    for (int w = head[set]; w != nil; w = next[idx(set, w)])
+        out[w] = r++;
+    assert(r == (uint64_t)numWays);
+}
+
+void
+LinkedList::load(uint32_t set, const std::vector<uint64_t>& ranks)
+{
+    std::vector<uint16_t> order(numWays);
+    for (int w = 0; w < numWays; ++w) order[ranks[w]] = w;
+
+    uint16_t *anc = anchor.data() + (size_t)set * numAnchors;
+    int k = 0;
+    for (int r = 0; r < numWays; ++r) {
+        const size_t i = idx(set, order[r]);
+        prev[i] = r > 0 ? order[r - 1] : nil;
+        next[i] = r + 1 < numWays ? order[r + 1] : nil;
+        if (k < numAnchors && anchorPos[k] == r) anc[k++] = order[r];
+        label[i] = k;
+    }
+    head[set] = order[0];
+    tail[set] = order[numWays - 1];
+}
+
+size_t
+LinkedList::bytesPerSet() const
+{
+    return numWays * (2 * sizeof(uint16_t) + sizeof(uint8_t)) +
+           2 * sizeof(uint16_t) + numAnchors * sizeof(uint16_t);
+}
+
+// ---------------- Bit matrix ----------------
+
+namespace
+{
+
+int
+rowWidth(int num_ways)
+{
+    int width = 2;
+    while (width < num_ways) width *= 2;
+    return width;
+}
+
+uint64_t
+laneBits(int width, int lanes)
+{
+    uint64_t bits = 0;
+    for (int l = 0; l < lanes; ++l) bits |= 1ULL << (l * width);
+    return bits;
+}
+
+} // anonymous namespace
+
+BitMatrix::BitMatrix(uint32_t num_sets, int num_ways)
+    : Backend(num_sets, num_ways),
+      width(rowWidth(num_ways)),
+      perWord(64 / width),
+      words((num_ways + perWord - 1) / perWord),
+      laneMask(width == 64 ? ~0ULL : (1ULL << width) - 1),
+      lowBits(laneBits(width, perWord)),
+      highBits(lowBits << (width - 1)),
+      padLanes((lowBits & ~laneBits(width, num_ways -
+                                               (words - 1) * perWord)) *
+               laneMask),
+      matrix((size_t)num_sets * words)
+{
+    assert(num_ways <= maxWays);
+    std::vector<uint64_t> identity(numWays);
+    for (int i = 0; i < numWays; ++i) identity[i] = i;
+    for (uint32_t s = 0; s < numSets; ++s) load(s, identity);
+}
+
+void
+BitMatrix::touch(uint32_t set, int way)
+{
+    // Nobody is more recent than way any more, and way is more recent
+    // than everybody else
+    uint64_t *m = rows(set);
+    const uint64_t column = ~(lowBits << way);
+    for (int w = 0; w < words; ++w) m[w] &= column;
+    const uint64_t full = numWays == 64 ? ~0ULL : (1ULL << numWays) - 1;
+    m[way / perWord] |= (full & ~(1ULL << way)) <<
+                        (way % perWord * width);
+}
+
+void
+BitMatrix::insertLRU(uint32_t set, int way)
+{
+    // Everybody is more recent than way, which is more recent than
+    // nobody
+    uint64_t *m = rows(set);
+    const uint64_t column = lowBits << way;
+    for (int w = 0; w < words - 1; ++w) m[w] |= column;
+    m[words - 1] |= column & ~padLanes;
+    m[way / perWord] &= ~(laneMask << (way % perWord * width));
+}
+
+void
+BitMatrix::insertAt(uint32_t set, int way, int pos)
+{
+    if (pos == numWays - 1) return touch(set, way);
+    if (pos == 0) return insertLRU(set, way);
+
+    // Rank the other ways without way; the pos oldest stay older
+    uint64_t *m = rows(set);
+    const uint64_t self = 1ULL << way;
+    uint64_t new_row = 0;
+    for (int j = 0; j < numWays; ++j) {
+        if (j == way) continue;
+        uint64_t &word = m[j / perWord];
+        const int shift = j % perWord * width;
+        if (__builtin_popcountll(row(m, j) & ~self) < pos) {
+            new_row |= 1ULL << j;
+            word &= ~(self << shift);
+        } else {
+            word |= self << shift;
+        }
+    }
+    const int shift = way % perWord * width;
+    uint64_t &word = m[way / perWord];
+    word = (word & ~(laneMask << shift)) | (new_row << shift);
+}
+
+int
+BitMatrix::lruWay(uint32_t set) const
+{
+    // Zero-lane test: the lowest flagged lane of a word is a zero lane
+    const uint64_t *m = rows(set);
+    for (int w = 0; w < words; ++w) {
+        uint64_t x = m[w];
+        if (w == words - 1) x |= padLanes & highBits;
+        const uint64_t zero = (x - lowBits) & ~x & highBits;
+        if (zero) return w * perWord + __builtin_ctzll(zero) / width;
+    }
+    assert(false);
+    return 0;
+}
+
+void
+BitMatrix::ranks(uint32_t set, std::vector<uint64_t>& out) const
+{
+    const uint64_t *m = rows(set);
+    out.resize(numWays);
+    for (int j = 0; j < numWays; ++j)
+        out[j] = __builtin_popcountll(row(m, j));
+}
+
+void
+BitMatrix::load(uint32_t set, const std::vector<uint64_t>& ranks)
+{
+    uint64_t *m = rows(set);
+    std::fill(m, m + words, 0);
+    for (int j = 0; j < numWays; ++j) {
+        uint64_t r = 0;
+        for (int k = 0; k < numWays; ++k) {
+            if (ranks[k] < ranks[j]) r |= 1ULL << k;
+        }
+        m[j / perWord] |= r << (j % perWord * width);
+    }
+}
+
+size_t
+BitMatrix::bytesPerSet() const
+{
+    return words * sizeof(uint64_t);
+}
+
+// ---------------- Packed nibbles ----------------
+
+namespace
+{
+
+const uint64_t nibbles = 0x0F0F0F0F0F0F0F0FULL;
+const uint64_t byteOnes = 0x0101010101010101ULL;
+const uint64_t byteHighs = 0x8080808080808080ULL;
+
+uint64_t
+byteLanes(int count)
+{
+    return count >= 8 ? ~0ULL : (1ULL << (8 * count)) - 1;
+}
+
+} // anonymous namespace
+
+PackedNibble::PackedNibble(uint32_t num_sets, int num_ways)
+    : Backend(num_sets, num_ways),
+      evenLanes(byteLanes((num_ways + 1) / 2)),
+      oddLanes(byteLanes(num_ways / 2)),
+      ages(num_sets)
+{
+    assert(num_ways <= maxWays);
+    std::vector<uint64_t> identity(numWays);
+    for (int i = 0; i < numWays; ++i) identity[i] = i;
+    for (uint32_t s = 0; s < numSets; ++s) load(s, identity);
+}
+
+void
+PackedNibble::touch(uint32_t set, int way)
+{
+    insertAt(set, way, numWays - 1);
+}
+
+void
+PackedNibble::insertAt(uint32_t set, int way, int pos)
+{
+    // Same update as AgeVector::insertAt() on every lane at once. With
+    // the guard bit set, a lane keeps its high bit after subtracting v
+    // exactly when it was >= v.
+    uint64_t x = ages[set];
+    const uint64_t old = (x >> (4 * way)) & 0xF;
+    uint64_t half[2] = { x & nibbles, (x >> 4) & nibbles };
+    const uint64_t lanes[2] = { evenLanes, oddLanes };
+    for (int h = 0; h < 2; ++h) {
+        uint64_t v = half[h];
+        v -= (((v | byteHighs) - (old + 1) * byteOnes) & byteHighs &
+              lanes[h]) >> 7;
+        v += (((v | byteHighs) - pos * byteOnes) & byteHighs &
+              lanes[h]) >> 7;
+        half[h] = v & nibbles;
+    }
+    x = half[0] | (half[1] << 4);
+    ages[set] = (x & ~(0xFULL << (4 * way))) | ((uint64_t)pos << (4 * way));
+}
+
+int
+PackedNibble::lruWay(uint32_t set) const
+{
+    const uint64_t x = ages[set];
+    const uint64_t even = x & nibbles;
+    const uint64_t odd = (x >> 4) & nibbles;
+    const uint64_t zero_even = (even - byteOnes) & ~even & byteHighs &
+                               evenLanes;
+    if (zero_even) return 2 * (__builtin_ctzll(zero_even) / 8);
+    const uint64_t zero_odd = (odd - byteOnes) & ~odd & byteHighs &
+                              oddLanes;
+    assert(zero_odd);
+    return 2 * (__builtin_ctzll(zero_odd) / 8) + 1;
+}
+
+void
+PackedNibble::ranks(uint32_t set, std::vector<uint64_t>& out) const
+{
+    out.resize(numWays);
+    for (int i = 0; i < numWays; ++i)
+        out[i] = (ages[set] >> (4 * i)) & 0xF;
+}
+
+void
+PackedNibble::load(uint32_t set, const std::vector<uint64_t>& ranks)
+{
+    uint64_t x = 0;
+    for (int i = 0; i < numWays; ++i) x |= ranks[i] << (4 * i);
+    ages[set] = x;
+}
+
+size_t
+PackedNibble::bytesPerSet() const
+{
+    return sizeof(uint64_t);
+}
+
+// ---------------- Permutation tables ----------------
+
+namespace
+{
+
+int
+factorial(int n)
+{
+    return n <= 1 ? 1 : n * factorial(n - 1);
+}
+
+} // anonymous namespace
+
+PermTable::Tables::Tables(int num_ways)
+    : numWays(num_ways), numStates(factorial(num_ways)),
+      touchNext((size_t)numStates * num_ways),
+      lruNext((size_t)numStates * num_ways),
+      victim(numStates)
+{
+    uint8_t order[maxWays], moved[maxWays];
+    for (int s = 0; s < numStates; ++s) {
+        decode(s, order);
+        victim[s] = order[0];
+        for (int pos = 0; pos < numWays; ++pos) {
+            const int way = order[pos];
+            // Promote: shift the younger ways down, way goes last
+            std::copy(order, order + pos, moved);
+            std::copy(order + pos + 1, order + numWays, moved + pos);
+            moved[numWays - 1] = way;
+            touchNext[s * numWays + way] = encode(moved);
+            // LRU insertion: shift the older ways up, way goes first
+            moved[0] = way;
+            std::copy(order, order + pos, moved + 1);
+            std::copy(order + pos + 1, order + numWays, moved + pos + 1);
+            lruNext[s * numWays + way] = encode(moved);
+        }
+    }
+}
+
+uint16_t
+PermTable::Tables::encode(const uint8_t* order) const
+{
+    // Lehmer code: digit i counts the later ways smaller than order[i]
+    int index = 0;
+    for (int i = 0; i < numWays; ++i) {
+        int smaller = 0;
+        for (int j = i + 1; j < numWays; ++j) smaller += order[j] < order[i];
+        index = index * (numWays - i) + smaller;
+    }
+    return index;
+}
+
+void
+PermTable::Tables::decode(uint16_t state, uint8_t* order) const
+{
+    int digits[maxWays];
+    int index = state;
+    for (int i = numWays - 1; i >= 0; --i) {
+        digits[i] = index % (numWays - i);
+        index /= numWays - i;
+    }
+    bool used[maxWays] = {};
+    for (int i = 0; i < numWays; ++i) {
+        int w = 0;
+        for (int skip = digits[i]; used[w] || skip--; ++w) {}
+        used[w] = true;
+        order[i] = w;
+    }
+}
+
+const PermTable::Tables&
+PermTable::tablesFor(int num_ways)
+{
+    static std::unique_ptr<Tables> cache[maxWays + 1];
+    if (!cache[num_ways]) cache[num_ways].reset(new Tables(num_ways));
+    return *cache[num_ways];
+}
+
+PermTable::PermTable(uint32_t num_sets, int num_ways)
+    : Backend(num_sets, num_ways), tables(tablesFor(num_ways)),
+      // State 0 is the identity order: way 0 at LRU
+      state(num_sets, 0)
+{
+    assert(num_ways <= maxWays);
+}
+
+void
+PermTable::touch(uint32_t set, int way)
+{
+    state[set] = tables.touchNext[state[set] * numWays + way];
+}
+
+void
+PermTable::insertLRU(uint32_t set, int way)
+{
+    state[set] = tables.lruNext[state[set] * numWays + way];
+}
+
+void
+PermTable::insertAt(uint32_t set, int way, int pos)
+{
+    if (pos == numWays - 1) return touch(set, way);
+    if (pos == 0) return insertLRU(set, way);
+
+    uint8_t order[maxWays], moved[maxWays];
+    tables.decode(state[set], order);
+    int j = 0;
+    for (int i = 0; i < numWays; ++i) {
+        if (j == pos) moved[j++] = way;
+        if (order[i] != way) moved[j++] = order[i];
+    }
+    state[set] = tables.encode(moved);
+}
+
+int
+PermTable::lruWay(uint32_t set) const
+{
+    return tables.victim[state[set]];
+}
+
+void
+PermTable::ranks(uint32_t set, std::vector<uint64_t>& out) const
+{
+    uint8_t order[maxWays];
+    tables.decode(state[set], order);
+    out.resize(numWays);
+    for (int pos = 0; pos < numWays; ++pos) out[order[pos]] = pos;
+}
+
+void
+PermTable::load(uint32_t set, const std::vector<uint64_t>& ranks)
+{
+    uint8_t order[maxWays];
+    for (int w = 0; w < numWays; ++w) order[ranks[w]] = w;
+    state[set] = tables.encode(order);
+}
+
+size_t
+PermTable::bytesPerSet() const
+{
+    return sizeof(uint16_t);
+}
+
+// ---------------- Timestamps ----------------
+
+Timestamp::Timestamp(uint32_t num_sets, int num_ways)
+    : Backend(num_sets, num_ways), stamps((size_t)num_sets * num_ways),
+      ceiling(num_sets), floor(num_sets)
+{
+    std::vector<uint64_t> identity(numWays);
+    for (int i = 0; i < numWays; ++i) identity[i] = i;
+    for (uint32_t s = 0; s < numSets; ++s) load(s, identity);
+}
+
+void
+Timestamp::touch(uint32_t set, int way)
+{
+    if (ceiling[set] == std::numeric_limits<Stamp>::max()) rebase(set);
+    row(set)[way] = ceiling[set]++;
+}
+
+void
+Timestamp::insertLRU(uint32_t set, int way)
+{
+    if (floor[set] == 0) rebase(set);
+    row(set)[way] = floor[set]--;
+}
+
+void
+Timestamp::insertAt(uint32_t set, int way, int pos)
+{
+    if (pos == numWays - 1) return touch(set, way);
+    if (pos == 0) return insertLRU(set, way);
+
+    // No free stamp between two neighbours in general: renumber the set
+    std::vector<uint64_t> r;
+    ranks(set, r);
+    const uint64_t old = r[way];
+    for (int i = 0; i < numWays; ++i) {
+        if (i == way) continue;
+        if (r[i] > old) r[i] -= 1;
+        if (r[i] >= (uint64_t)pos) r[i] += 1;
+    }
+    r[way] = pos;
+    load(set, r);
+}
+
+int
+Timestamp::lruWay(uint32_t set) const
+{
+    const Stamp *v = row(set);
+    return std::min_element(v, v + numWays) - v;
+}
+
+void
+Timestamp::ranks(uint32_t set, std::vector<uint64_t>& out) const
+{
+    const Stamp *v = row(set);
+    std::vector<int> order(numWays);
+    for (int i = 0; i < numWays; ++i) order[i] = i;
+    std::sort(order.begin(), order.end(),
+              [v](int a, int b) { return v[a] < v[b]; });
+    out.resize(numWays);
+    for (int pos = 0; pos < numWays; ++pos) out[order[pos]] = pos;
+}
+
+void
+Timestamp::load(uint32_t set, const std::vector<uint64_t>& ranks)
+{
+    const Stamp base = std::numeric_limits<Stamp>::max() / 2 - numWays / 2;
+    Stamp *v = row(set);
+    for (int i = 0; i < numWays; ++i) v[i] = base + ranks[i];
+    ceiling[set] = base + numWays;
+    floor[set] = base - 1;
+}
+
+void
+Timestamp::rebase(uint32_t set)
+{
+    std::vector<uint64_t> r;
+    ranks(set, r);
+    load(set, r);
+    ++numRebases;
+}
+
+size_t
+Timestamp::bytesPerSet() const
+{
+    return (numWays + 2) * sizeof(Stamp);
+}
+
+// ---------------- Deferred promotions ----------------
+
+Deferred::Deferred(std::unique_ptr<Backend> _inner, uint32_t num_sets,
+                   int num_ways, int _depth)
+    : Backend(num_sets, num_ways), inner(std::move(_inner)),
+      depth(std::max(1, std::min(_depth, maxDepth))),
+      fullName(std::string("deferred_") + inner->name()),
+      pending((size_t)num_sets * depth), numPending(num_sets, 0)
+{
+}
+
+void
+Deferred::touch(uint32_t set, int way)
+{
+    uint16_t *buf = &pending[(size_t)set * depth];
+    int n = numPending[set];
+    if (n > 0 && buf[n - 1] == way) return;
+    if (n == depth) {
+        fold(set);
+        n = 0;
+    }
+    buf[n] = way;
+    numPending[set] = n + 1;
+    ++numDeferred;
+}
+
+void
+Deferred::fold(uint32_t set) const
+{
+    const int n = numPending[set];
+    if (n == 0) return;
+    // Keep the last touch of every way: scan backwards, skipping ways
+    // already seen, then restore the order
+    const uint16_t *buf = &pending[(size_t)set * depth];
+    uint16_t ways[maxDepth];
+    int count = 0;
+    for (int i = n - 1; i >= 0; --i) {
+        if (std::find(ways, ways + count, buf[i]) == ways + count)
+            ways[count++] = buf[i];
+    }
+    std::reverse(ways, ways + count);
+    inner->touchAll(set, ways, count);
+    numPending[set] = 0;
+    ++numFolds;
+}
+
+void
+Deferred::insertAt(uint32_t set, int way, int pos)
+{
+    fold(set);
+    inner->insertAt(set, way, pos);
+}
+
+void
+Deferred::insertLRU(uint32_t set, int way)
+{
+    fold(set);
+    inner->insertLRU(set, way);
+}
+
+int
+Deferred::lruWay(uint32_t set) const
+{
+    fold(set);
+    return inner->lruWay(set);
+}
+
+void
+Deferred::ranks(uint32_t set, std::vector<uint64_t>& out) const
+{
+    inner->ranks(set, out);
+    const uint16_t *buf = &pending[(size_t)set * depth];
+    for (int i = 0; i < numPending[set]; ++i) {
+        const uint64_t old = out[buf[i]];
+        for (auto &r : out) {
+            if (r > old) --r;
+        }
+        out[buf[i]] = numWays - 1;
+    }
+}
+
+void
+Deferred::load(uint32_t set, const std::vector<uint64_t>& ranks)
+{
+    numPending[set] = 0;
+    inner->load(set, ranks);
+}
+
+size_t
+Deferred::bytesPerSet() const
+{
+    return inner->bytesPerSet() + depth * sizeof(uint16_t) +
+           sizeof(uint8_t);
+}
+
+bool
+supports(Kind kind, int num_ways)
+{
+    switch (kind) {
+      case Kind::BitMatrix:
+        return num_ways <= BitMatrix::maxWays;
+      case Kind::PackedNibble:
+        return num_ways <= PackedNibble::maxWays;
+      case Kind::PermTable:
+        return num_ways <= PermTable::maxWays;
+      default:
+        return num_ways < 0xffff;
+    }
+}
+
+std::unique_ptr<Backend>
+create(Kind kind, uint32_t num_sets, int num_ways, int num_anchors,
+       int defer_depth)
+{
+    if (num_ways <= 0 || !supports(kind, num_ways)) return nullptr;
+    if (defer_depth > 0) {
+        return std::unique_ptr<Backend>(new Deferred(
+            create(kind, num_sets, num_ways, num_anchors), num_sets,
+            num_ways, defer_depth));
+    }
+    switch (kind) {
+      case Kind::AgeVector:
+        return std::unique_ptr<Backend>(new AgeVector(num_sets, num_ways));
+      case Kind::LinkedList:
+        return std::unique_ptr<Backend>(
+            new LinkedList(num_sets, num_ways, num_anchors));
+      case Kind::BitMatrix:
+        return std::unique_ptr<Backend>(new BitMatrix(num_sets, num_ways));
+      case Kind::PackedNibble:
+        return std::unique_ptr<Backend>(
+            new PackedNibble(num_sets, num_ways));
+      case Kind::PermTable:
+        return std::unique_ptr<Backend>(new PermTable(num_sets, num_ways));
+      case Kind::Timestamp:
+        return std::unique_ptr<Backend>(new Timestamp(num_sets, num_ways));
+    }
+    return nullptr;
+}
+
+} // namespace IPVRecency
@@ -0,0 +1,398 @@
+#ifndef __MEM_CACHE_REPLACEMENT_POLICIES_LRU_IPV_RECENCY_HH__
+#define __MEM_CACHE_REPLACEMENT_POLICIES_LRU_IPV_RECENCY_HH__
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * Recency-order backends for LRUIPVRP.
+ *
+ * A backend keeps, for every set of a cache, the exact recency order of
+ * its ways. Position 0 is the LRU end and position numWays-1 the MRU end.
+ * All backends start with way 0 at LRU and way numWays-1 at MRU, and all
+ * of them implement the same operations with the same result, so the
+ * choice of backend only changes the cost of each operation.
+ *
+ * The backends do not depend on gem5 so they can be benchmarked on their
+ * own.
+ */
+namespace IPVRecency
+{
+
+enum class Kind
+{
+    AgeVector,
+    LinkedList,
+    BitMatrix,
+    PackedNibble,
+    PermTable,
+    Timestamp,
+};
+
+class Backend
+{
+  public:
+    Backend(uint32_t num_sets, int num_ways)
+        : numSets(num_sets), numWays(num_ways) {}
+    virtual ~Backend() = default;
+
+    /** Promote way to MRU (hit or MRU insertion). */
+    virtual void touch(uint32_t set, int way) = 0;
+
+    /**
+     * Promote count distinct ways to MRU, in order, as count calls to
+     * touch() would.
+     */
+    virtual void touchAll(uint32_t set, const uint16_t* ways, int count);
+
+    /** Move way to position pos (0 = LRU, numWays-1 = MRU). */
+    virtual void insertAt(uint32_t set, int way, int pos) = 0;
+
+    /** Move way to the LRU end (near-LRU insertion, invalidation). */
+    virtual void insertLRU(uint32_t set, int way) { insertAt(set, way, 0); }
+
+    /** Way at the LRU end. */
+    virtual int lruWay(uint32_t set) const = 0;
+
+    /** Position of every way of the set (0 = LRU), indexed by way. */
+    virtual void ranks(uint32_t set, std::vector<uint64_t>& out) const = 0;
+
+    /** Replace the order of a set by the given per-way positions. */
+    virtual void load(uint32_t set, const std::vector<uint64_t>& ranks) = 0;
+
+    /** Host memory used per set, in bytes. */
+    virtual size_t bytesPerSet() const = 0;
+
+    virtual const char* name() const = 0;
+
+  protected:
+    const uint32_t numSets;
+    const int numWays;
+};
+
+/**
+ * One age per way, kept as a permutation of 0..numWays-1. Every operation
+ * is a single O(numWays) pass over the set's ages.
+ */
+class AgeVector : public Backend
+{
+  public:
+    AgeVector(uint32_t num_sets, int num_ways);
+
+    void touch(uint32_t set, int way) override;
+    void touchAll(uint32_t set, const uint16_t* ways, int count) override;
+    void insertAt(uint32_t set, int way, int pos) override;
+    int lruWay(uint32_t set) const override;
+    void ranks(uint32_t set, std::vector<uint64_t>& out) const override;
+    void load(uint32_t set, const std::vector<uint64_t>& ranks) override;
+    size_t bytesPerSet() const override;
+    const char* name() const override { return "age_vector"; }
+
+  private:
+    uint16_t* row(uint32_t set) { return &ages[(size_t)set * numWays]; }
+    const uint16_t* row(uint32_t set) const
+    {
+        return &ages[(size_t)set * numWays];
+    }
+
+    std::vector<uint16_t> ages;
+};
+
+/**
+ * Index-linked doubly linked list per set, head = LRU, tail = MRU.
+ * Promotion and LRU insertion relink a node in O(1).
+ *
+ * Insertion at an arbitrary position uses skip anchors: anchor k always
+ * points to the way at the fixed quantile position anchorPos[k], and
+ * every way records how many anchors lie at or before it. That label
+ * tells which anchors shift when a way is unlinked, so keeping the
+ * anchors exact costs O(numAnchors) per operation. An arbitrary position
+ * is then reached by walking at most numWays/(numAnchors+1) links from
+ * the closest anchor or end.
+ */
+class LinkedList : public Backend
+{
+  public:
+    LinkedList(uint32_t num_sets, int num_ways, int num_anchors);
+
+    void touch(uint32_t set, int way) override;
+    void insertAt(uint32_t set, int way, int pos) override;
+    void insertLRU(uint32_t set, int way) override;
+    int lruWay(uint32_t set) const override;
+    void ranks(uint32_t set, std::vector<uint64_t>& out) const override;
+    void load(uint32_t set, const std::vector<uint64_t>& ranks) override;
+    size_t bytesPerSet() const override;
+    const char* name() const override { return "linked_list"; }
+
+  private:
+    static constexpr uint16_t nil = 0xffff;
+
+    /** Remove way from the list of the set, keeping anchors exact. */
+    void unlink(uint32_t set, int way);
+    /** Link an unlinked way so that it ends up at position pos. */
+    void link(uint32_t set, int way, int pos);
+    /** Way at position pos while one way of the set is unlinked. */
+    int wayAt(uint32_t set, int pos) const;
+
+    size_t idx(uint32_t set, int way) const
+    {
+        return (size_t)set * numWays + way;
+    }
+
+    const int numAnchors;
+    /** Position tracked by each anchor, increasing, at most numWays-2 */
+    std::vector<int> anchorPos;
+
+    std::vector<uint16_t> prev;
+    std::vector<uint16_t> next;
+    /** Number of anchors at or before each way */
+    std::vector<uint8_t> label;
+    std::vector<uint16_t> head;
+    std::vector<uint16_t> tail;
+    /** numAnchors anchored ways per set */
+    std::vector<uint16_t> anchor;
+};
+
+/**
+ * numWays x numWays bit matrix per set, for up to 64 ways: bit j of row i
+ * is set when way i is more recent than way j, so the LRU way is the one
+ * with an all-zero row. Rows are padded to a power-of-two width and
+ * packed 64/width to a word; an 8-way set is a single word. Promotion
+ * sets a row and clears a column, LRU insertion clears a row and sets a
+ * column, both a few word-wide bit operations, and the LRU way is found
+ * with a zero-lane test per word.
+ */
+class BitMatrix : public Backend
+{
+  public:
+    BitMatrix(uint32_t num_sets, int num_ways);
+
+    static constexpr int maxWays = 64;
+
+    void touch(uint32_t set, int way) override;
+    void insertAt(uint32_t set, int way, int pos) override;
+    void insertLRU(uint32_t set, int way) override;
+    int lruWay(uint32_t set) const override;
+    void ranks(uint32_t set, std::vector<uint64_t>& out) const override;
+    void load(uint32_t set, const std::vector<uint64_t>& ranks) override;
+    size_t bytesPerSet() const override;
+    const char* name() const override { return "bit_matrix"; }
+
+  private:
+    uint64_t* rows(uint32_t set) { return &matrix[(size_t)set * words]; }
+    const uint64_t* rows(uint32_t set) const
+    {
+        return &matrix[(size_t)set * words];
+    }
+    uint64_t row(const uint64_t* m, int way) const
+    {
+        return (m[way / perWord] >> (way % perWord * width)) & laneMask;
+    }
+
+    /** Bits per row (power of two >= numWays) */
+    const int width;
+    /** Rows per 64-bit word */
+    const int perWord;
+    /** Words per set */
+    const int words;
+    const uint64_t laneMask;
+    /** Lowest / highest bit of every lane of a word */
+    const uint64_t lowBits;
+    const uint64_t highBits;
+    /** Lanes of the last word that hold no row */
+    const uint64_t padLanes;
+
+    std::vector<uint64_t> matrix;
+};
+
+/**
+ * 4-bit ages packed in one 64-bit word per set, for up to 16 ways. Updates
+ * are done on all ages at once: the even and odd nibbles are spread to
+ * byte lanes, which leaves a guard bit for the SWAR comparisons.
+ */
+class PackedNibble : public Backend
+{
+  public:
+    PackedNibble(uint32_t num_sets, int num_ways);
+
+    static constexpr int maxWays = 16;
+
+    void touch(uint32_t set, int way) override;
+    void insertAt(uint32_t set, int way, int pos) override;
+    int lruWay(uint32_t set) const override;
+    void ranks(uint32_t set, std::vector<uint64_t>& out) const override;
+    void load(uint32_t set, const std::vector<uint64_t>& ranks) override;
+    size_t bytesPerSet() const override;
+    const char* name() const override { return "packed_nibble"; }
+
+  private:
+    /** Byte lanes of the even / odd ways that exist */
+    const uint64_t evenLanes;
+    const uint64_t oddLanes;
+
+    std::vector<uint64_t> ages;
+};
+
+/**
+ * Whole recency order of a set as one state number, for up to 8 ways: an
+ * 8-way order is one of 8! = 40320 permutations, which fits in 16 bits.
+ * Promotion and LRU insertion of every way, and the LRU way of every
+ * state, are precomputed, so each of them is a single table load. The
+ * tables are built once per associativity and shared by all caches
+ * (1.3MB for 8 ways, a few kB below). Arbitrary-position insertion
+ * decodes and re-encodes the permutation.
+ */
+class PermTable : public Backend
+{
+  public:
+    PermTable(uint32_t num_sets, int num_ways);
+
+    static constexpr int maxWays = 8;
+
+    void touch(uint32_t set, int way) override;
+    void insertAt(uint32_t set, int way, int pos) override;
+    void insertLRU(uint32_t set, int way) override;
+    int lruWay(uint32_t set) const override;
+    void ranks(uint32_t set, std::vector<uint64_t>& out) const override;
+    void load(uint32_t set, const std::vector<uint64_t>& ranks) override;
+    size_t bytesPerSet() const override;
+    const char* name() const override { return "perm_table"; }
+
+    /** Transition tables of one associativity. */
+    struct Tables
+    {
+        explicit Tables(int num_ways);
+
+        /** Lexicographic index of an order (order[pos] = way) */
+        uint16_t encode(const uint8_t* order) const;
+        void decode(uint16_t state, uint8_t* order) const;
+
+        const int numWays;
+        /** numWays! states */
+        const int numStates;
+        /** Next state after promoting / LRU-inserting a way,
+         *  indexed by state * numWays + way */
+        std::vector<uint16_t> touchNext;
+        std::vector<uint16_t> lruNext;
+        /** LRU way of every state */
+        std::vector<uint8_t> victim;
+    };
+
+  private:
+    static const Tables& tablesFor(int num_ways);
+
+    const Tables& tables;
+    std::vector<uint16_t> state;
+};
+
+/**
+ * One stamp per way, larger = more recent. Each set hands out stamps
+ * from two counters that start in the middle of the stamp range: the
+ * ceiling grows for promotions and the floor shrinks for LRU
+ * insertions, so both are a single store. Only lruWay() pays O(numWays),
+ * with an argmin. When a counter reaches the end of the range, the set
+ * is rebased: its stamps are renumbered around the middle, keeping the
+ * order.
+ */
+class Timestamp : public Backend
+{
+  public:
+    typedef uint32_t Stamp;
+
+    Timestamp(uint32_t num_sets, int num_ways);
+
+    void touch(uint32_t set, int way) override;
+    void insertAt(uint32_t set, int way, int pos) override;
+    void insertLRU(uint32_t set, int way) override;
+    int lruWay(uint32_t set) const override;
+    void ranks(uint32_t set, std::vector<uint64_t>& out) const override;
+    void load(uint32_t set, const std::vector<uint64_t>& ranks) override;
+    size_t bytesPerSet() const override;
+    const char* name() const override { return "timestamp"; }
+
+    /** Number of rebases so far */
+    uint64_t rebases() const { return numRebases; }
+
+  private:
+    Stamp* row(uint32_t set) { return &stamps[(size_t)set * numWays]; }
+    const Stamp* row(uint32_t set) const
+    {
+        return &stamps[(size_t)set * numWays];
+    }
+
+    /** Renumber the set's stamps around the middle of the range. */
+    void rebase(uint32_t set);
+
+    std::vector<Stamp> stamps;
+    /** Next stamp handed out to a promotion */
+    std::vector<Stamp> ceiling;
+    /** Next stamp handed out to an LRU insertion */
+    std::vector<Stamp> floor;
+    uint64_t numRebases = 0;
+};
+
+/**
+ * Wrapper that defers hit promotions. A touch() only appends the way to
+ * a small per-set buffer, and a touch of the way that was touched last
+ * is dropped. The buffer is folded into the wrapped backend with one
+ * touchAll() when the exact order is needed (lruWay(), insertions) or
+ * when it is full. Folding keeps the last touch of every way, in order,
+ * which is exactly what promoting eagerly would have done. ranks()
+ * applies the buffer to a copy and leaves it pending.
+ */
+class Deferred : public Backend
+{
+  public:
+    Deferred(std::unique_ptr<Backend> inner, uint32_t num_sets,
+             int num_ways, int depth);
+
+    static constexpr int maxDepth = 64;
+
+    void touch(uint32_t set, int way) override;
+    void insertAt(uint32_t set, int way, int pos) override;
+    void insertLRU(uint32_t set, int way) override;
+    int lruWay(uint32_t set) const override;
+    void ranks(uint32_t set, std::vector<uint64_t>& out) const override;
+    void load(uint32_t set, const std::vector<uint64_t>& ranks) override;
+    size_t bytesPerSet() const override;
+    const char* name() const override { return fullName.c_str(); }
+
+    /** Number of buffered touches, and of folds of a buffer */
+    uint64_t deferred() const { return numDeferred; }
+    uint64_t folds() const { return numFolds; }
+
+  private:
+    /** Apply the pending touches of a set to the wrapped backend. */
+    void fold(uint32_t set) const;
+
+    const std::unique_ptr<Backend> inner;
+    const int depth;
+    const std::string fullName;
+
+    /** depth pending ways per set, oldest first */
+    mutable std::vector<uint16_t> pending;
+    mutable std::vector<uint8_t> numPending;
+
+    uint64_t numDeferred = 0;
+    mutable uint64_t numFolds = 0;
+};
+
+/** Whether a backend can represent sets of num_ways ways. */
+bool supports(Kind kind, int num_ways);
+
+/**
+ * Create a backend, or return nullptr if it does not support num_ways.
+ *
+ * @param num_anchors Skip anchors per set of the LinkedList backend.
+ * @param defer_depth Wrap the backend in a Deferred with this buffer
+ *                    depth, if non-zero.
+ */
+std::unique_ptr<Backend> create(Kind kind, uint32_t num_sets, int num_ways,
+                                int num_anchors = 4, int defer_depth = 0);
+
+} // namespace IPVRecency
+
+#endif // __MEM_CACHE_REPLACEMENT_POLICIES_LRU_IPV_RECENCY_HH__
@@ -0,0 +1,134 @@
+#include "mem/cache/replacement_policies/shadow_tags.hh"
+
+#include <algorithm>
+
+#include "base/intmath.hh"
+#include "base/logging.hh"
+#include "sim/system.hh"
+
+ShadowTags::ShadowTags(const ShadowTagsParams &p)
+    : ProbeListenerObject(p),
+      numWays(p.assoc),
+      numSets(std::max<uint64_t>(1, p.size / (p.block_size *
+                                              std::max(1, p.assoc)))),
+      setShift(floorLog2(p.block_size)),
+      tagShift(setShift + floorLog2(numSets)),
+      stride(std::max<uint32_t>(1, numSets /
+                                   std::max<uint32_t>(1, p.sample_sets))),
+      numSampled(numSets / stride),
+      system(p.system),
+      stats(*this)
+{
+    fatal_if(numWays <= 0, "ShadowTags: assoc must be > 0");
+    fatal_if(!isPowerOf2(p.block_size) || !isPowerOf2(numSets),
+             "ShadowTags: block size and number of sets must be powers "
+             "of 2");
+    fatal_if(p.policies.empty(), "ShadowTags: no policies to evaluate");
+    fatal_if(!p.labels.empty() && p.labels.size() != p.policies.size(),
+             "ShadowTags: labels must name every policy");
+
+    // Entries are instantiated set by set, way by way, like the tags do
+    for (size_t i = 0; i < p.policies.size(); ++i) {
+        dirs.push_back({p.policies[i],
+                        std::vector<ShadowBlk>((size_t)numSampled *
+                                               numWays)});
+        auto &blks = dirs.back().blks;
+        for (size_t b = 0; b < blks.size(); ++b) {
+            blks[b].setPosition(b / numWays, b % numWays);
+            blks[b].replacementData = p.policies[i]->instantiateEntry();
+        }
+        labels.push_back(p.labels.empty() ? p.policies[i]->name()
+                                          : p.labels[i]);
+    }
+}
+
+void
+ShadowTags::regProbeListeners()
+{
+    listeners.push_back(new ProbeListenerArg<ShadowTags, PacketPtr>(
+        this, "Hit", &ShadowTags::observe));
+    listeners.push_back(new ProbeListenerArg<ShadowTags, PacketPtr>(
+        this, "Miss", &ShadowTags::observe));
+}
+
+void
+ShadowTags::startup()
+{
+    // Atomic accesses do not notify the Hit and Miss probes
+    warn_if(system->isAtomicMode(), "%s: the memory system is in atomic "
+            "mode, so the shadow tags see no accesses until it switches "
+            "to timing; the shadow stats only cover timing mode.",
+            name());
+}
+
+void
+ShadowTags::observe(const PacketPtr &pkt)
+{
+    if (pkt->isCleanEviction()) return;
+
+    const Addr addr = pkt->getAddr();
+    const uint32_t set = (addr >> setShift) & (numSets - 1);
+    if (set % stride != 0 || set / stride >= numSampled) return;
+    const uint32_t shadow_set = set / stride;
+    const Addr tag = addr >> tagShift;
+    const bool secure = pkt->isSecure();
+
+    stats.accesses++;
+    for (size_t i = 0; i < dirs.size(); ++i) {
+        auto &dir = dirs[i];
+        ShadowBlk *first = &dir.blks[(size_t)shadow_set * numWays];
+
+        ShadowBlk *hit = nullptr;
+        ReplacementCandidates candidates;
+        candidates.reserve(numWays);
+        for (int way = 0; way < numWays; ++way) {
+            ShadowBlk &blk = first[way];
+            candidates.push_back(&blk);
+            if (blk.valid && blk.tag == tag && blk.secure == secure)
+                hit = &blk;
+        }
+
+        if (hit) {
+            dir.policy->touch(hit->replacementData, pkt);
+            stats.hits[i]++;
+            continue;
+        }
+
+        stats.misses[i]++;
+        auto *victim = static_cast<ShadowBlk *>(
+            dir.policy->getVictim(candidates));
+        if (victim->valid) dir.policy->invalidate(victim->replacementData);
+        victim->tag = tag;
+        victim->secure = secure;
+        victim->valid = true;
+        dir.policy->reset(victim->replacementData, pkt);
+    }
+}
+
+ShadowTags::ShadowStats::ShadowStats(ShadowTags &_shadow)
+    : Stats::Group(&_shadow),
+      shadow(_shadow),
+      ADD_STAT(accesses, "Accesses to the sampled sets"),
+      ADD_STAT(hits, "Hits per shadowed policy on the sampled sets"),
+      ADD_STAT(misses, "Misses per shadowed policy on the sampled sets"),
+      ADD_STAT(missRate, "Miss rate per shadowed policy on the sampled "
+               "sets")
+{
+}
+
+void
+ShadowTags::ShadowStats::regStats()
+{
+    Stats::Group::regStats();
+
+    const size_t n = shadow.dirs.size();
+    hits.init(n);
+    misses.init(n);
+    for (size_t i = 0; i < n; ++i) {
+        hits.subname(i, shadow.labels[i]);
+        misses.subname(i, shadow.labels[i]);
+        missRate.subname(i, shadow.labels[i]);
+    }
+    missRate.flags(Stats::nonan).precision(6);
+    missRate = misses / accesses;
+}
@@ -0,0 +1,101 @@
+#ifndef __MEM_CACHE_REPLACEMENT_POLICIES_SHADOW_TAGS_HH__
+#define __MEM_CACHE_REPLACEMENT_POLICIES_SHADOW_TAGS_HH__
+
+#include <string>
+#include <vector>
+
+#include "base/statistics.hh"
+#include "base/types.hh"
+#include "mem/cache/replacement_policies/base.hh"
+#include "mem/cache/replacement_policies/replaceable_entry.hh"
+#include "mem/packet.hh"
+#include "params/ShadowTags.hh"
+#include "sim/probe/probe.hh"
+
+class System;
+
+/**
+ * ShadowTags — concurrent evaluation of replacement policies.
+ *
+ * Listens to the Hit and Miss probes of a cache and replays every access
+ * to a sample of its sets into one auxiliary tag directory per
+ * replacement policy. Each directory has the geometry of the sampled
+ * sets of the cache and is managed by its own policy, so all policies
+ * see exactly the access stream of the real cache in a single run. The
+ * directories hold tags only and never respond to anything: the timing
+ * and contents of the real cache are unaffected.
+ *
+ * - Sampled sets are spread evenly over the cache: one set every
+ *   numSets / sample_sets. Directory set i shadows cache set i * stride,
+ *   and the policies see the directory set index.
+ * - A lookup hit calls touch(); a miss takes getVictim() among the ways
+ *   of the directory set, invalidate()s a valid victim and reset()s the
+ *   filled way, as BaseSetAssoc does. Packets are passed along so that
+ *   requestor, PC and prefetch aware policies behave as in a cache.
+ * - Clean evictions do not allocate and are ignored; writebacks are
+ *   accesses like any other.
+ * - Stats give, per policy, the accesses, hits and misses observed and
+ *   the miss rate on the sampled sets.
+ * - The Hit and Miss probes only fire on the timing path of the cache:
+ *   while the memory system is in atomic mode (fast-forward, functional
+ *   warming) nothing is observed, which startup() warns about.
+ * - Policies that size their state by the cache (LRUIPVRP's cache_size)
+ *   only need the numSampled sets; CacheConfig gives them that size.
+ */
+class ShadowTags : public ProbeListenerObject
+{
+  public:
+    explicit ShadowTags(const ShadowTagsParams &p);
+
+    void regProbeListeners() override;
+    void startup() override;
+
+    /** Replay one cache access into all directories. */
+    void observe(const PacketPtr &pkt);
+
+  private:
+    struct ShadowBlk : public ReplaceableEntry
+    {
+        Addr tag = 0;
+        bool secure = false;
+        bool valid = false;
+    };
+
+    /** Tag directory of one policy, numSampled * numWays blocks */
+    struct Directory
+    {
+        ReplacementPolicy::Base *policy;
+        std::vector<ShadowBlk> blks;
+    };
+
+    const int numWays;
+    const uint32_t numSets;       ///< Sets of the observed cache
+    const int setShift;           ///< log2(block size)
+    const int tagShift;           ///< setShift + log2(numSets)
+    const uint32_t stride;        ///< Cache sets per sampled set
+    const uint32_t numSampled;    ///< Sampled sets
+
+    System *system;
+
+    std::vector<Directory> dirs;
+    std::vector<std::string> labels;
+
+    struct ShadowStats : public Stats::Group
+    {
+        ShadowStats(ShadowTags &shadow);
+
+        void regStats() override;
+
+        const ShadowTags &shadow;
+
+        /** Accesses to the sampled sets */
+        Stats::Scalar accesses;
+        /** Per-policy hits and misses on the sampled sets */
+        Stats::Vector hits;
+        Stats::Vector misses;
+        /** Per-policy miss rate on the sampled sets */
+        Stats::Formula missRate;
+    } stats;
+};
+
+#endif // __MEM_CACHE_REPLACEMENT_POLICIES_SHADOW_TAGS_HH__
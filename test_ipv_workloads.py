@@ -0,0 +1,39 @@
+import os
+import shutil
+import tempfile
+import unittest
+
+import ipv_replay
+import ipv_workloads
+
+
+class TraceRoundTripTest(unittest.TestCase):
+    """Traces of ipv_workloads read back as the same lines."""
+
+    def setUp(self):
+        self.dir = tempfile.mkdtemp()
+
+    def tearDown(self):
+        shutil.rmtree(self.dir)
+
+    def round_trip(self, pattern, name, block_size=64):
+        lines = list(ipv_workloads.lines(pattern, '64kB', 5000,
+                                         block_size))
+        path = os.path.join(self.dir, name)
+        ipv_workloads.write_trace(lines, path, block_size)
+        self.assertEqual(ipv_replay.read_trace(path, block_size), lines)
+
+    def test_every_pattern(self):
+        for pattern in sorted(ipv_workloads.PATTERNS):
+            with self.subTest(pattern=pattern):
+                self.round_trip(pattern, pattern + '.trace')
+
+    def test_gzip(self):
+        self.round_trip('cyclic', 'cyclic.trace.gz')
+
+    def test_block_size(self):
+        self.round_trip('chase', 'chase.trace', block_size=128)
+
+
+if __name__ == '__main__':
+    unittest.main()